@@ -0,0 +1,669 @@
+// Headless benchmark for the myGp procedurals: no renderer, no GPU.
+//
+// A source mesh (a synthetic torus of --faces faces, or the first mesh of --mesh file.usd)
+// and one procedural prim live in an HdRetainedSceneIndex. Every frame deforms the mesh
+// points; every --topology-every frames the mesh topology changes as well. The procedural is
+// either driven directly, timing UpdateDependencies/Update/GetChildPrim/GetTypedValue one by
+// one (--mode direct), or through an HdGpGenerativeProceduralResolvingSceneIndex, where the
+// procedural update runs inside the dirty notification (--mode sceneIndex).
+// --check-stencils TOL instead matches the per-patch-type stencil kernels against
+// Far::LimitStencilTableFactory and fails when they differ by more than TOL.
+//
+//   mygpBench --procedural fur --faces 1000000 --frames 50 --output result.json
+//   mygpBench --mesh torus.usd --check-stencils 1e-5
+
+#include "gp_fur.h"
+#include "gp_furLayout.h"
+#include "gp_mesh.h"
+#include "gp_topologyCache.h"
+
+#include <pxr/base/plug/plugin.h>
+#include <pxr/base/plug/registry.h>
+#include <pxr/base/tf/stringUtils.h>
+#include <pxr/imaging/hd/basisCurvesSchema.h>
+#include <pxr/imaging/hd/basisCurvesTopologySchema.h>
+#include <pxr/imaging/hd/meshSchema.h>
+#include <pxr/imaging/hd/meshTopologySchema.h>
+#include <pxr/imaging/hd/primvarsSchema.h>
+#include <pxr/imaging/hd/retainedDataSource.h>
+#include <pxr/imaging/hd/retainedSceneIndex.h>
+#include <pxr/imaging/hdGp/generativeProceduralResolvingSceneIndex.h>
+#include <pxr/usd/usd/primRange.h>
+#include <pxr/usd/usd/stage.h>
+#include <pxr/usd/usdGeom/mesh.h>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+PXR_NAMESPACE_USING_DIRECTIVE
+
+namespace {
+struct Options
+{
+    std::string procedural  = "fur";    // fur | mesh
+    std::string mode        = "direct"; // direct | sceneIndex
+    std::string meshFile;
+    std::string output;
+    std::string pluginPath  = MYGP_PLUGINFO_DIR;
+    int faces               = 10000;
+    int frames              = 100;
+    int topologyEvery       = 10;
+    float numSamplesPerFace = 20.0f;
+    int maxCurves           = 0;
+    int childrenPerGuide    = 0;
+    int numShards           = 0;
+    std::string quality     = "full"; // preview | medium | full
+    float length            = 0.2f;
+    int meshSize            = 100;
+    int tileSize            = 0;
+    double checkStencils    = 0.0; // tolerance; 0 runs the benchmark
+};
+
+// A sampled value the benchmark overwrites between frames, followed by a DirtyPrims.
+template <typename T>
+class _MutableDataSource : public HdTypedSampledDataSource<T>
+{
+public:
+    HD_DECLARE_DATASOURCE(_MutableDataSource<T>);
+    using Time = HdSampledDataSource::Time;
+
+    VtValue GetValue(Time shutterOffset) override { return VtValue(GetTypedValue(shutterOffset)); }
+    T GetTypedValue(Time) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _value;
+    }
+    bool GetContributingSampleTimesForInterval(Time, Time, std::vector<Time>*) override { return false; }
+    void Set(T const& value)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _value = value;
+    }
+
+private:
+    _MutableDataSource(T const& value)
+        : _value(value)
+    {
+    }
+    std::mutex _mutex;
+    T _value;
+};
+
+struct Mesh
+{
+    VtIntArray faceVertexCounts, faceVertexIndices;
+    VtVec3fArray points;
+};
+
+Mesh
+makeTorus(int numFaces)
+{
+    int nu = std::max(3, int(std::sqrt(2.0 * numFaces)));
+    int nv = std::max(3, numFaces / nu);
+    Mesh mesh;
+    mesh.points.resize(size_t(nu) * nv);
+    mesh.faceVertexCounts.assign(size_t(nu) * nv, 4);
+    mesh.faceVertexIndices.resize(4 * size_t(nu) * nv);
+    for (int u = 0; u < nu; ++u)
+    {
+        for (int v = 0; v < nv; ++v)
+        {
+            float a = 2.0f * float(M_PI) * u / nu, b = 2.0f * float(M_PI) * v / nv;
+            mesh.points[u * nv + v] = GfVec3f((1.0f + 0.3f * std::cos(b)) * std::cos(a),
+                                              0.3f * std::sin(b),
+                                              (1.0f + 0.3f * std::cos(b)) * std::sin(a));
+            int* face = &mesh.faceVertexIndices[4 * (u * nv + v)];
+            face[0]   = u * nv + v;
+            face[1]   = u * nv + (v + 1) % nv;
+            face[2]   = ((u + 1) % nu) * nv + (v + 1) % nv;
+            face[3]   = ((u + 1) % nu) * nv + v;
+        }
+    }
+    return mesh;
+}
+
+bool
+loadMesh(std::string const& path, Mesh* mesh)
+{
+    UsdStageRefPtr stage = UsdStage::Open(path);
+    if (!stage)
+    {
+        return false;
+    }
+    for (UsdPrim const& prim : stage->Traverse())
+    {
+        if (UsdGeomMesh geomMesh = UsdGeomMesh(prim))
+        {
+            geomMesh.GetFaceVertexCountsAttr().Get(&mesh->faceVertexCounts);
+            geomMesh.GetFaceVertexIndicesAttr().Get(&mesh->faceVertexIndices);
+            geomMesh.GetPointsAttr().Get(&mesh->points);
+            return true;
+        }
+    }
+    return false;
+}
+
+// An open, bumpy grid of n x n cells with some cells split into triangles and a pair merged
+// into a hexagon, for the boundaries, non-quads and extraordinary vertices a torus lacks.
+Mesh
+makeOpenMesh(int n)
+{
+    Mesh mesh;
+    auto vertex = [&](int i, int j) { return j * (n + 1) + i; };
+    for (int j = 0; j <= n; ++j)
+    {
+        for (int i = 0; i <= n; ++i)
+        {
+            float x = float(i) / n, y = float(j) / n;
+            mesh.points.push_back(GfVec3f(x, y, 0.2f * std::sin(3.0f * x) * std::cos(2.0f * y)));
+        }
+    }
+    std::vector<int> counts, indices;
+    for (int j = 0; j < n; ++j)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            int a = vertex(i, j), b = vertex(i + 1, j), c = vertex(i + 1, j + 1), d = vertex(i, j + 1);
+            if (i == 2 && j == 2)
+            {
+                counts.push_back(6);
+                indices.insert(indices.end(), { a, b, vertex(i + 2, j), vertex(i + 2, j + 1), c, d });
+            }
+            else if (i == 3 && j == 2)
+            {
+                continue; // part of the hexagon
+            }
+            else if ((i + 2 * j) % 5 == 0)
+            {
+                counts.insert(counts.end(), { 3, 3 });
+                indices.insert(indices.end(), { a, b, c, a, c, d });
+            }
+            else
+            {
+                counts.push_back(4);
+                indices.insert(indices.end(), { a, b, c, d });
+            }
+        }
+    }
+    mesh.faceVertexCounts  = VtIntArray(counts.begin(), counts.end());
+    mesh.faceVertexIndices = VtIntArray(indices.begin(), indices.end());
+    return mesh;
+}
+
+// Runs MyFurLayout::CompareStencilBuilders on the benchmark mesh and the open mesh, with
+// both boundary rules and the full and medium quality tiers. Declined cases fall back to
+// Far in the procedural, so only a difference above tolerance fails.
+bool
+checkStencils(Mesh const& mesh, int numSamplesPerFace, double tolerance)
+{
+    using PatchOptions    = OpenSubdiv::Far::PatchTableFactory::Options;
+    using Sdc             = OpenSubdiv::Sdc::Options;
+    Mesh const open       = makeOpenMesh(8);
+    bool passed           = true;
+    for (auto const& source : { std::make_pair("mesh", &mesh), std::make_pair("open", &open) })
+    {
+        for (auto boundary : { Sdc::VTX_BOUNDARY_EDGE_ONLY, Sdc::VTX_BOUNDARY_EDGE_AND_CORNER })
+        {
+            for (bool medium : { false, true })
+            {
+                MyTopologyOptions options;
+                options.boundary = boundary;
+                if (medium)
+                {
+                    options.isolationLevel = 2;
+                    options.endCap         = PatchOptions::ENDCAP_BSPLINE_BASIS;
+                }
+                Mesh const& m                = *source.second;
+                MyTopologySharedPtr topology = MyTopologyCache::GetInstance().Get(
+                    m.faceVertexCounts, m.faceVertexIndices, int(m.points.size()), options);
+                double error = topology
+                                   ? MyFurLayout::CompareStencilBuilders(*topology, numSamplesPerFace, m.points.cdata())
+                                   : -1.0;
+                bool failed  = error > tolerance;
+                passed       = passed && !failed;
+                std::cout << "stencils " << source.first << " boundary="
+                          << (boundary == Sdc::VTX_BOUNDARY_EDGE_ONLY ? "edge" : "corner")
+                          << " quality=" << (medium ? "medium" : "full") << ": ";
+                if (error < 0.0)
+                {
+                    std::cout << "declined\n";
+                }
+                else
+                {
+                    std::cout << error << (failed ? " FAILED" : "") << "\n";
+                }
+            }
+        }
+    }
+    return passed;
+}
+
+// A different topology with the same face counts: every face starts one vertex later.
+VtIntArray
+rotateFaces(VtIntArray const& counts, VtIntArray const& indices)
+{
+    VtIntArray rotated(indices.size());
+    for (size_t face = 0, offset = 0; face < counts.size(); offset += counts[face++])
+    {
+        for (int i = 0; i < counts[face]; ++i)
+        {
+            rotated[offset + i] = indices[offset + (i + 1) % counts[face]];
+        }
+    }
+    return rotated;
+}
+
+VtVec3fArray
+deform(VtVec3fArray const& rest, int frame)
+{
+    VtVec3fArray points(rest.size());
+    for (size_t i = 0; i < rest.size(); ++i)
+    {
+        GfVec3f p = rest[i];
+        points[i] = p + GfVec3f(0.0f, 0.05f * std::sin(0.2f * frame + 4.0f * p[0]), 0.0f);
+    }
+    return points;
+}
+
+HdContainerDataSourceHandle
+primvar(HdDataSourceBaseHandle value, TfToken const& interpolation, TfToken const& role = TfToken())
+{
+    return HdPrimvarSchema::Builder()
+        .SetPrimvarValue(HdSampledDataSource::Cast(value))
+        .SetInterpolation(HdPrimvarSchema::BuildInterpolationDataSource(interpolation))
+        .SetRole(role.IsEmpty() ? nullptr : HdPrimvarSchema::BuildRoleDataSource(role))
+        .Build();
+}
+
+using Clock = std::chrono::steady_clock;
+
+double
+millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+struct Frame
+{
+    int frame;
+    bool topology;
+    std::map<std::string, double> phases;
+    size_t numElements = 0;
+};
+
+// Pulls every output array of a child prim, which is where the lazy procedurals do their work.
+size_t
+pullChild(HdContainerDataSourceHandle const& dataSource)
+{
+    size_t numElements = 0;
+    auto pull          = [&](HdDataSourceBaseHandle const& ds) {
+        if (HdSampledDataSourceHandle sampled = HdSampledDataSource::Cast(ds))
+        {
+            VtValue value = sampled->GetValue(0.0f);
+            numElements += value.IsArrayValued() ? value.GetArraySize() : 1;
+        }
+    };
+    HdBasisCurvesTopologySchema curves = HdBasisCurvesSchema::GetFromParent(dataSource).GetTopology();
+    pull(curves.GetCurveVertexCounts());
+    pull(curves.GetCurveIndices());
+    HdMeshTopologySchema mesh = HdMeshSchema::GetFromParent(dataSource).GetTopology();
+    pull(mesh.GetFaceVertexCounts());
+    pull(mesh.GetFaceVertexIndices());
+    pull(HdPrimvarsSchema::GetFromParent(dataSource).GetPrimvar(HdPrimvarsSchemaTokens->points).GetPrimvarValue());
+    return numElements;
+}
+
+void
+writeStats(std::ostream& out, std::vector<double> values)
+{
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values)
+    {
+        sum += v;
+    }
+    out << "{\"count\": " << values.size();
+    if (!values.empty())
+    {
+        out << ", \"mean\": " << sum / values.size() << ", \"median\": " << values[values.size() / 2]
+            << ", \"min\": " << values.front() << ", \"max\": " << values.back();
+    }
+    out << "}";
+}
+
+void
+writeJson(std::ostream& out, Options const& options, size_t numFaces, std::vector<Frame> const& frames)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    MyTopologyCache::Stats cache = MyTopologyCache::GetInstance().GetStats();
+
+    out << "{\n  \"config\": {\"procedural\": \"" << options.procedural << "\", \"mode\": \"" << options.mode
+        << "\", \"mesh\": \"" << (options.meshFile.empty() ? "torus" : options.meshFile)
+        << "\", \"sourceFaces\": " << numFaces << ", \"frames\": " << options.frames
+        << ", \"topologyEvery\": " << options.topologyEvery << ", \"numSamplesPerFace\": " << options.numSamplesPerFace
+        << ", \"maxCurves\": " << options.maxCurves << ", \"childrenPerGuide\": " << options.childrenPerGuide
+        << ", \"numShards\": " << options.numShards << ", \"quality\": \"" << options.quality << "\""
+        << ", \"meshSize\": " << options.meshSize << ", \"tileSize\": " << options.tileSize << "},\n";
+    out << "  \"peakRssKiB\": " << usage.ru_maxrss << ",\n";
+    out << "  \"topologyCache\": {\"hits\": " << cache.hits << ", \"misses\": " << cache.misses
+        << ", \"evictions\": " << cache.evictions << ", \"bytes\": " << cache.bytes << "},\n";
+
+    out << "  \"summary\": {";
+    char const* sep = "";
+    for (bool topology : { true, false })
+    {
+        std::map<std::string, std::vector<double>> phases;
+        for (Frame const& frame : frames)
+        {
+            if (frame.topology == topology)
+            {
+                for (auto const& phase : frame.phases)
+                {
+                    phases[phase.first].push_back(phase.second);
+                }
+            }
+        }
+        out << sep << "\n    \"" << (topology ? "topology" : "points") << "\": {";
+        char const* phaseSep = "";
+        for (auto const& phase : phases)
+        {
+            out << phaseSep << "\n      \"" << phase.first << "\": ";
+            writeStats(out, phase.second);
+            phaseSep = ",";
+        }
+        out << "}";
+        sep = ",";
+    }
+    out << "\n  },\n  \"frames\": [";
+    sep = "";
+    for (Frame const& frame : frames)
+    {
+        out << sep << "\n    {\"frame\": " << frame.frame << ", \"kind\": \""
+            << (frame.topology ? "topology" : "points") << "\", \"elements\": " << frame.numElements;
+        for (auto const& phase : frame.phases)
+        {
+            out << ", \"" << phase.first << "\": " << phase.second;
+        }
+        out << "}";
+        sep = ",";
+    }
+    out << "\n  ]\n}\n";
+}
+
+bool
+parseOptions(int argc, char** argv, Options* options)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << "missing value for " << arg << "\n";
+            return false;
+        }
+        std::string value = argv[++i];
+        if (arg == "--procedural")
+            options->procedural = value;
+        else if (arg == "--mode")
+            options->mode = value;
+        else if (arg == "--mesh")
+            options->meshFile = value;
+        else if (arg == "--output")
+            options->output = value;
+        else if (arg == "--plugin-path")
+            options->pluginPath = value;
+        else if (arg == "--faces")
+            options->faces = std::stoi(value);
+        else if (arg == "--frames")
+            options->frames = std::stoi(value);
+        else if (arg == "--topology-every")
+            options->topologyEvery = std::stoi(value);
+        else if (arg == "--samples")
+            options->numSamplesPerFace = std::stof(value);
+        else if (arg == "--max-curves")
+            options->maxCurves = std::stoi(value);
+        else if (arg == "--children")
+            options->childrenPerGuide = std::stoi(value);
+        else if (arg == "--shards")
+            options->numShards = std::stoi(value);
+        else if (arg == "--quality")
+            options->quality = value;
+        else if (arg == "--length")
+            options->length = std::stof(value);
+        else if (arg == "--mesh-size")
+            options->meshSize = std::stoi(value);
+        else if (arg == "--tile-size")
+            options->tileSize = std::stoi(value);
+        else if (arg == "--check-stencils")
+            options->checkStencils = std::stod(value);
+        else
+        {
+            std::cerr << "unknown option " << arg << "\n";
+            return false;
+        }
+    }
+    return (options->procedural == "fur" || options->procedural == "mesh") &&
+           (options->mode == "direct" || options->mode == "sceneIndex");
+}
+} // namespace
+
+int
+main(int argc, char** argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, &options))
+    {
+        std::cerr << "usage: mygpBench [--procedural fur|mesh] [--mode direct|sceneIndex] [--faces N | --mesh file.usd]\n"
+                     "                 [--frames N] [--topology-every N] [--samples N] [--max-curves N]\n"
+                     "                 [--children N] [--shards N] [--quality Q] [--length L] [--mesh-size N] [--tile-size N]\n"
+                     "                 [--plugin-path dir] [--output file.json] [--check-stencils tolerance]\n";
+        return 1;
+    }
+
+    Mesh rest;
+    if (!options.meshFile.empty())
+    {
+        if (!loadMesh(options.meshFile, &rest))
+        {
+            std::cerr << "no mesh found in " << options.meshFile << "\n";
+            return 1;
+        }
+    }
+    else
+    {
+        rest = makeTorus(options.faces);
+    }
+    if (options.checkStencils > 0.0)
+    {
+        return checkStencils(rest, std::max(1, int(options.numSamplesPerFace)), options.checkStencils) ? 0 : 1;
+    }
+    VtIntArray rotatedIndices = rotateFaces(rest.faceVertexCounts, rest.faceVertexIndices);
+
+    // Source mesh
+    SdfPath const meshPath("/World/mesh");
+    auto countsDs  = _MutableDataSource<VtIntArray>::New(rest.faceVertexCounts);
+    auto indicesDs = _MutableDataSource<VtIntArray>::New(rest.faceVertexIndices);
+    auto pointsDs  = _MutableDataSource<VtVec3fArray>::New(rest.points);
+    HdContainerDataSourceHandle meshDs = HdRetainedContainerDataSource::New(
+        HdMeshSchemaTokens->mesh,
+        HdMeshSchema::Builder()
+            .SetTopology(HdMeshTopologySchema::Builder().SetFaceVertexCounts(countsDs).SetFaceVertexIndices(indicesDs).Build())
+            .Build(),
+        HdPrimvarsSchemaTokens->primvars,
+        // The undeformed points double as the rest pose the fur layout is spread over.
+        HdRetainedContainerDataSource::New(
+            HdPrimvarsSchemaTokens->points,
+            primvar(pointsDs, HdPrimvarSchemaTokens->vertex, HdPrimvarSchemaTokens->point),
+            TfToken("rest"),
+            primvar(HdRetainedTypedSampledDataSource<VtVec3fArray>::New(rest.points),
+                    HdPrimvarSchemaTokens->vertex,
+                    HdPrimvarSchemaTokens->point)));
+
+    // Procedural
+    SdfPath const procPath("/World/proc");
+    bool const fur  = options.procedural == "fur";
+    auto meshSizeDs = _MutableDataSource<float>::New(float(options.meshSize));
+    auto paramDs    = _MutableDataSource<float>::New(0.0f);
+    std::vector<TfToken> names;
+    std::vector<HdDataSourceBaseHandle> values;
+    auto addPrimvar = [&](TfToken const& name, HdDataSourceBaseHandle const& value) {
+        names.push_back(name);
+        values.push_back(primvar(value, HdPrimvarSchemaTokens->constant));
+    };
+    addPrimvar(HdGpGenerativeProceduralTokens->proceduralType,
+               HdRetainedTypedSampledDataSource<TfToken>::New(TfToken(fur ? "MyProceduralFur" : "MyProceduralMesh")));
+    if (fur)
+    {
+        addPrimvar(TfToken("sourceMeshPath"), HdRetainedTypedSampledDataSource<VtArray<SdfPath>>::New({ meshPath }));
+        addPrimvar(TfToken("numSamplesPerFace"), HdRetainedTypedSampledDataSource<float>::New(options.numSamplesPerFace));
+        addPrimvar(TfToken("length"), HdRetainedTypedSampledDataSource<float>::New(options.length));
+        addPrimvar(TfToken("maxCurves"), HdRetainedTypedSampledDataSource<int>::New(options.maxCurves));
+        addPrimvar(TfToken("childrenPerGuide"), HdRetainedTypedSampledDataSource<int>::New(options.childrenPerGuide));
+        addPrimvar(TfToken("numShards"), HdRetainedTypedSampledDataSource<int>::New(options.numShards));
+        addPrimvar(TfToken("quality"), HdRetainedTypedSampledDataSource<TfToken>::New(TfToken(options.quality)));
+    }
+    else
+    {
+        addPrimvar(TfToken("size"), meshSizeDs);
+        addPrimvar(TfToken("param"), paramDs);
+        addPrimvar(TfToken("tileSize"), HdRetainedTypedSampledDataSource<int>::New(options.tileSize));
+    }
+    HdContainerDataSourceHandle procDs = HdRetainedContainerDataSource::New(
+        HdPrimvarsSchemaTokens->primvars, HdRetainedContainerDataSource::New(names.size(), names.data(), values.data()));
+
+    HdRetainedSceneIndexRefPtr scene = HdRetainedSceneIndex::New();
+    scene->AddPrims({ { meshPath, HdPrimTypeTokens->mesh, meshDs } });
+
+    std::unique_ptr<HdGpGenerativeProcedural> procedural;
+    HdSceneIndexBaseRefPtr resolved;
+    if (options.mode == "direct")
+    {
+        scene->AddPrims({ { procPath, HdGpGenerativeProceduralTokens->generativeProcedural, procDs } });
+        procedural.reset(fur ? MyProceduralFur::New(procPath) : MyProceduralMesh::New(procPath));
+    }
+    else
+    {
+        PlugRegistry::GetInstance().RegisterPlugins(options.pluginPath);
+        // The resolving scene index skips procedural types it cannot load, so a broken
+        // plugInfo.json would otherwise only show up as a scene without curves.
+        PlugPluginPtr plugin = PlugRegistry::GetInstance().GetPluginWithName("myGp");
+        if (!plugin || !plugin->Load())
+        {
+            std::cerr << "cannot load the myGp plugin from " << options.pluginPath << "\n";
+            return 1;
+        }
+        resolved = HdGpGenerativeProceduralResolvingSceneIndex::New(scene);
+    }
+
+    std::vector<Frame> frames;
+    HdGpGenerativeProcedural::ChildPrimTypeMap children;
+    for (int f = 0; f < options.frames; ++f)
+    {
+        Frame frame;
+        frame.frame    = f;
+        frame.topology = f == 0 || (options.topologyEvery > 0 && f % options.topologyEvery == 0);
+
+        // Scene edits for this frame; they are not timed.
+        HdDataSourceLocatorSet meshDirty{ HdPrimvarsSchema::GetPointsLocator() };
+        HdDataSourceLocatorSet procDirty;
+        if (fur)
+        {
+            pointsDs->Set(deform(rest.points, f));
+            if (frame.topology && f > 0)
+            {
+                indicesDs->Set((f / options.topologyEvery) % 2 ? rotatedIndices : rest.faceVertexIndices);
+                meshDirty.insert(HdMeshTopologySchema::GetDefaultLocator());
+            }
+        }
+        else
+        {
+            paramDs->Set(0.1f * f);
+            procDirty.insert(HdPrimvarsSchema::GetDefaultLocator());
+            if (frame.topology && f > 0)
+            {
+                meshSizeDs->Set(float(options.meshSize + (f / options.topologyEvery) % 2));
+            }
+        }
+
+        if (procedural)
+        {
+            HdGpGenerativeProcedural::DependencyMap dirtied;
+            if (f > 0)
+            {
+                dirtied[fur ? meshPath : procPath] = fur ? meshDirty : procDirty;
+            }
+            Clock::time_point start = Clock::now();
+            procedural->UpdateDependencies(scene);
+            frame.phases["updateDependencies"] = millisecondsSince(start);
+
+            HdSceneIndexObserver::DirtiedPrimEntries dirtiedPrims;
+            start                  = Clock::now();
+            children               = procedural->Update(scene, children, dirtied, &dirtiedPrims);
+            frame.phases["update"] = millisecondsSince(start);
+
+            std::vector<HdSceneIndexPrim> prims;
+            start = Clock::now();
+            for (auto const& child : children)
+            {
+                prims.push_back(procedural->GetChildPrim(scene, child.first));
+            }
+            frame.phases["getChildPrim"] = millisecondsSince(start);
+
+            start = Clock::now();
+            for (HdSceneIndexPrim const& prim : prims)
+            {
+                frame.numElements += pullChild(prim.dataSource);
+            }
+            frame.phases["getTypedValue"] = millisecondsSince(start);
+        }
+        else
+        {
+            // UpdateDependencies and Update run inside the notification.
+            Clock::time_point start = Clock::now();
+            if (f == 0)
+            {
+                scene->AddPrims({ { procPath, HdGpGenerativeProceduralTokens->generativeProcedural, procDs } });
+            }
+            else
+            {
+                scene->DirtyPrims({ { fur ? meshPath : procPath, fur ? meshDirty : procDirty } });
+            }
+            frame.phases["notify"] = millisecondsSince(start);
+
+            std::vector<HdSceneIndexPrim> prims;
+            start = Clock::now();
+            for (SdfPath const& childPath : resolved->GetChildPrimPaths(procPath))
+            {
+                prims.push_back(resolved->GetPrim(childPath));
+            }
+            frame.phases["getChildPrim"] = millisecondsSince(start);
+
+            start = Clock::now();
+            for (HdSceneIndexPrim const& prim : prims)
+            {
+                frame.numElements += pullChild(prim.dataSource);
+            }
+            frame.phases["getTypedValue"] = millisecondsSince(start);
+        }
+        frames.push_back(frame);
+    }
+
+    if (options.output.empty())
+    {
+        writeJson(std::cout, options, rest.faceVertexCounts.size(), frames);
+    }
+    else
+    {
+        std::ofstream out(options.output);
+        writeJson(out, options, rest.faceVertexCounts.size(), frames);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+#include "gp_arrayPool.h"
+
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+// Idle buffers kept per pool until SetCapacity; covers the memo slots of a few shards plus
+// what the render delegate still holds from the previous frame.
+constexpr size_t defaultMaxIdleBuffers = 64;
+} // namespace
+
+struct MyVec3fArrayPool::_State
+{
+    // Idle buffers by capacity, so a fit is found with lower_bound.
+    using Idle = std::multimap<size_t, _Buffer*>;
+
+    ~_State();
+
+    mutable std::mutex mutex;
+    size_t maxIdleBuffers = defaultMaxIdleBuffers;
+    Idle idle;
+};
+
+struct MyVec3fArrayPool::_Buffer : public Vt_ArrayForeignDataSource
+{
+    _Buffer(std::weak_ptr<_State> const& owner, size_t capacity)
+        : Vt_ArrayForeignDataSource(&_Detached)
+        , state(owner)
+        , data(new GfVec3f[capacity])
+        , capacity(capacity)
+    {
+        // The map node is allocated here, so returning the buffer to the pool never does.
+        _State::Idle scratch;
+        node = scratch.extract(scratch.emplace(capacity, this));
+    }
+
+    // Called when no VtArray refers to the buffer any more.
+    static void _Detached(Vt_ArrayForeignDataSource* self)
+    {
+        _Buffer* buffer = static_cast<_Buffer*>(self);
+        if (std::shared_ptr<_State> state = buffer->state.lock())
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            if (state->idle.size() < state->maxIdleBuffers)
+            {
+                state->idle.insert(std::move(buffer->node));
+                return;
+            }
+        }
+        delete buffer;
+    }
+
+    std::weak_ptr<_State> state;
+    std::unique_ptr<GfVec3f[]> data;
+    size_t capacity;
+    _State::Idle::node_type node; // (capacity, this) while the buffer is in use
+};
+
+MyVec3fArrayPool::_State::~_State()
+{
+    for (auto const& entry : idle)
+    {
+        delete entry.second;
+    }
+}
+
+MyVec3fArrayPool::MyVec3fArrayPool(MyProceduralStatsSharedPtr const& stats)
+    : _stats(stats)
+    , _state(std::make_shared<_State>())
+{
+}
+
+MyVec3fArrayPool::~MyVec3fArrayPool() = default;
+
+void
+MyVec3fArrayPool::SetCapacity(size_t maxIdleBuffers)
+{
+    std::vector<_Buffer*> freed;
+    {
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        if (maxIdleBuffers == _state->maxIdleBuffers)
+        {
+            return;
+        }
+        _state->maxIdleBuffers = maxIdleBuffers;
+        // The largest buffers go first.
+        while (_state->idle.size() > maxIdleBuffers)
+        {
+            auto largest = std::prev(_state->idle.end());
+            freed.push_back(largest->second);
+            _state->idle.erase(largest);
+        }
+    }
+    for (_Buffer* buffer : freed)
+    {
+        delete buffer;
+    }
+}
+
+VtVec3fArray
+MyVec3fArrayPool::Allocate(size_t size, GfVec3f** data)
+{
+    if (size == 0)
+    {
+        *data = nullptr;
+        return VtVec3fArray();
+    }
+
+    _Buffer* buffer = nullptr;
+    {
+        // Smallest idle buffer that fits without wasting more than half of it.
+        std::lock_guard<std::mutex> lock(_state->mutex);
+        auto best = _state->idle.lower_bound(size);
+        if (best != _state->idle.end() && best->first <= 2 * size)
+        {
+            buffer       = best->second;
+            buffer->node = _state->idle.extract(best);
+        }
+    }
+    if (!buffer)
+    {
+        buffer = new _Buffer(_state, size);
+        if (_stats)
+        {
+            _stats->AddBytesAllocated(size * sizeof(GfVec3f));
+        }
+    }
+    *data = buffer->data.get();
+    return VtVec3fArray(buffer, buffer->data.get(), size);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "gp_stats.h"
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/vt/array.h>
+#include <pxr/pxr.h>
+
+#include <memory>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Recycles the storage of output point arrays. Arrays are backed by pooled buffers through
+// Vt_ArrayForeignDataSource: once the last VtArray sharing a buffer is released (by us or by
+// the render delegate) the buffer goes back to the pool instead of the heap, so steady-state
+// frames write into the storage of earlier frames. Buffers still in use when the pool is
+// destroyed are freed with their last array.
+class MyVec3fArrayPool
+{
+public:
+    // New buffers are accounted to stats, when given.
+    explicit MyVec3fArrayPool(MyProceduralStatsSharedPtr const& stats = nullptr);
+    ~MyVec3fArrayPool();
+
+    MyVec3fArrayPool(MyVec3fArrayPool const&)            = delete;
+    MyVec3fArrayPool& operator=(MyVec3fArrayPool const&) = delete;
+
+    // Most idle buffers kept for reuse (64 by default); any returned beyond that are freed.
+    // Size it for everything that holds arrays in steady state, or frames allocate again.
+    void SetCapacity(size_t maxIdleBuffers);
+
+    // An array of size uninitialized elements. Fill it through *data before publishing it:
+    // VtArray never treats foreign storage as unique, so its non-const accessors would copy.
+    VtVec3fArray Allocate(size_t size, GfVec3f** data);
+
+private:
+    struct _Buffer;
+    struct _State;
+
+    MyProceduralStatsSharedPtr _stats;
+    std::shared_ptr<_State> _state;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
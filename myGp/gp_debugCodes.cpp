@@ -0,0 +1,14 @@
+#include "gp_debugCodes.h"
+
+#include "pxr/base/tf/registryManager.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_REGISTRY_FUNCTION(TfDebug)
+{
+    TF_DEBUG_ENVIRONMENT_SYMBOL(MYGP_TOPOLOGY_CACHE, "Topology cache misses and evictions");
+    TF_DEBUG_ENVIRONMENT_SYMBOL(MYGP_REFINER, "OpenSubdiv refiner and patch table rebuilds");
+    TF_DEBUG_ENVIRONMENT_SYMBOL(MYGP_FUR_LAYOUT, "Fur layout and stencil rebuilds");
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <pxr/base/tf/debug.h>
+#include <pxr/pxr.h>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Enable with TF_DEBUG=MYGP_* (e.g. TF_DEBUG="MYGP_REFINER MYGP_TOPOLOGY_CACHE").
+TF_DEBUG_CODES(MYGP_TOPOLOGY_CACHE, MYGP_REFINER, MYGP_FUR_LAYOUT);
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -1,124 +1,451 @@
 #include "gp_fur.h"
+#include "gp_furEvaluator.h"
+#include "gp_stats.h"
 
 #include "pxr/imaging/hd/basisCurvesSchema.h"
 #include "pxr/imaging/hd/basisCurvesTopologySchema.h"
+#include "pxr/imaging/hd/cameraSchema.h"
 #include "pxr/imaging/hd/meshSchema.h"
 #include "pxr/imaging/hd/meshTopologySchema.h"
 #include "pxr/imaging/hd/primvarsSchema.h"
 #include "pxr/imaging/hd/retainedDataSource.h"
 #include "pxr/imaging/hd/tokens.h"
-
-#include <opensubdiv/far/patchMap.h>
-#include <opensubdiv/far/patchTableFactory.h>
-#include <opensubdiv/far/primvarRefiner.h>
-#include <opensubdiv/far/topologyDescriptor.h>
+#include "pxr/imaging/hd/xformSchema.h"
+#include "pxr/base/gf/camera.h"
+#include "pxr/base/gf/frustum.h"
+#include "pxr/base/gf/vec3d.h"
+#include "pxr/base/tf/stringUtils.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
+
+#include <algorithm>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
 #include <numeric>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
 TF_DEFINE_PRIVATE_TOKENS(_tokens,
-                         (child)             //
-                         (sourceMeshPath)    //
-                         (numSamplesPerFace) //
-                         (length)            //
+                         (child)                  //
+                         (sourceMeshPath)         //
+                         (numSamplesPerFace)      //
+                         (length)                 //
+                         (maxCurves)              //
+                         (density)                //
+                         (rest)                   //
+                         (childrenPerGuide)       //
+                         (clump)                  //
+                         (quality)                //
+                         (lookAheadFrames)        //
+                         (cullingCamera)          //
+                         (cullingMargin)          //
+                         (cullingBackfaces)       //
+                         (cullingFalloffDistance) //
+                         (numShards)              //
+                         (curvesPerShard)         //
+                         (stats)                  //
 );
 
 namespace {
 //------------------------------------------------------------------------------
-struct Vertex
+// Hydra, motion blur and every render delegate ask for the same handful of shutter
+// offsets over and over, so a few slots are enough to answer repeats without recomputing.
+// Values are kept typed; boxing an array into a VtValue costs a heap allocation.
+// Hydra pulls from many threads while Update may clear the memo, so a value only gets in
+// if no Clear happened since the reader took its generation: Update publishes new inputs
+// before clearing, so anything computed from older inputs is dropped.
+template <typename T>
+class TimeMemo
 {
-    Vertex()
-        : point(0)
+public:
+    using Time = HdSampledDataSource::Time;
+
+    static constexpr size_t Capacity = MyFurEvaluator::MaxTimes;
+
+    bool Find(Time time, T* value) const
     {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int i = 0; i < _size; ++i)
+        {
+            if (_times[i] == time)
+            {
+                *value = _values[i];
+                return true;
+            }
+        }
+        return false;
     }
-    void Clear(void* = 0) { point.Set(0, 0, 0); }
-    void AddWithWeight(Vertex const& src, float weight) { point += weight * src.point; }
-    GfVec3f point;
+    uint64_t GetGeneration() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _generation;
+    }
+    void Store(Time time, T const& value, uint64_t generation)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (generation != _generation)
+        {
+            return;
+        }
+        _times[_next]  = time;
+        _values[_next] = value;
+        _next          = (_next + 1) % _numSlots;
+        _size          = std::min(_size + 1, _numSlots);
+    }
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (T& value : _values)
+        {
+            value = T();
+        }
+        _size = _next = 0;
+        ++_generation;
+    }
+
+private:
+    static constexpr int _numSlots = int(Capacity);
+    mutable std::mutex _mutex;
+    Time _times[_numSlots];
+    T _values[_numSlots];
+    int _size            = 0;
+    int _next            = 0;
+    uint64_t _generation = 0;
 };
-struct LimitFrame
+
+template <typename T>
+T
+getValue(HdSampledDataSourceHandle const& ds, HdSampledDataSource::Time shutterOffset, T const& defaultValue)
 {
-    void Clear(void* = 0)
+    return ds ? ds->GetValue(shutterOffset).GetWithDefault<T>(defaultValue) : defaultValue;
+}
+
+// Counts may be authored as int or float.
+int
+getCount(HdSampledDataSourceHandle const& ds, HdSampledDataSource::Time shutterOffset, int defaultValue)
+{
+    if (!ds)
     {
-        point.Set(0, 0, 0);
-        deriv1.Set(0, 0, 0);
-        deriv2.Set(0, 0, 0);
+        return defaultValue;
     }
-    void AddWithWeight(Vertex const& src, float weight, float d1Weight, float d2Weight)
+    VtValue v = ds->GetValue(shutterOffset);
+    return v.IsHolding<int>() ? v.UncheckedGet<int>() : int(v.GetWithDefault<float>(float(defaultValue)));
+}
+
+// Targets of a relationship primvar (source meshes, culling camera), in authored order and
+// without duplicates.
+std::vector<SdfPath>
+getTargetPaths(HdSampledDataSourceHandle const& relationshipDs)
+{
+    std::vector<SdfPath> paths;
+    VtValue v = relationshipDs ? relationshipDs->GetValue(0.0f) : VtValue();
+    if (v.IsHolding<VtArray<SdfPath>>())
     {
-        point += weight * src.point;
-        deriv1 += d1Weight * src.point;
-        deriv2 += d2Weight * src.point;
+        for (SdfPath const& path : v.UncheckedGet<VtArray<SdfPath>>())
+        {
+            if (!path.IsEmpty() && std::find(paths.begin(), paths.end(), path) == paths.end())
+            {
+                paths.push_back(path);
+            }
+        }
     }
-    GfVec3f point, deriv1, deriv2;
-};
+    return paths;
+}
 
-inline int
-numQuadFaces(VtIntArray const &faceVertexCounts)
+// Culling camera of the procedural, brought into the space of the fur: the curves are
+// children of the procedural and use the source mesh points as they are.
+MyFurCullingParams
+getCullingParams(HdSceneIndexBaseRefPtr const& inputScene, HdSceneIndexPrim const& myPrim, HdPrimvarsSchema& primvars)
 {
-    return std::accumulate(faceVertexCounts.begin(), faceVertexCounts.end(), 0, [](int total, int nverts) {
-        return total + (nverts == 4 ? 1 : nverts);
-    });
+    MyFurCullingParams params;
+    std::vector<SdfPath> cameraPaths = getTargetPaths(primvars.GetPrimvar(_tokens->cullingCamera).GetPrimvarValue());
+    if (cameraPaths.empty())
+    {
+        return params;
+    }
+    HdSceneIndexPrim cameraPrim = inputScene->GetPrim(cameraPaths[0]);
+    HdCameraSchema cameraSchema = HdCameraSchema::GetFromParent(cameraPrim.dataSource);
+    if (!cameraSchema)
+    {
+        return params;
+    }
+
+    // The schema has apertures and focal length in scene units, GfCamera in tenths of them.
+    GfCamera camera;
+    if (HdMatrixDataSourceHandle xform = HdXformSchema::GetFromParent(cameraPrim.dataSource).GetMatrix())
+    {
+        camera.SetTransform(xform->GetTypedValue(0.0f));
+    }
+    if (HdTokenDataSourceHandle projection = cameraSchema.GetProjection())
+    {
+        camera.SetProjection(projection->GetTypedValue(0.0f) == HdCameraSchemaTokens->orthographic
+                                 ? GfCamera::Orthographic
+                                 : GfCamera::Perspective);
+    }
+    if (HdFloatDataSourceHandle ds = cameraSchema.GetHorizontalAperture())
+    {
+        camera.SetHorizontalAperture(ds->GetTypedValue(0.0f) / GfCamera::APERTURE_UNIT);
+    }
+    if (HdFloatDataSourceHandle ds = cameraSchema.GetVerticalAperture())
+    {
+        camera.SetVerticalAperture(ds->GetTypedValue(0.0f) / GfCamera::APERTURE_UNIT);
+    }
+    if (HdFloatDataSourceHandle ds = cameraSchema.GetHorizontalApertureOffset())
+    {
+        camera.SetHorizontalApertureOffset(ds->GetTypedValue(0.0f) / GfCamera::APERTURE_UNIT);
+    }
+    if (HdFloatDataSourceHandle ds = cameraSchema.GetVerticalApertureOffset())
+    {
+        camera.SetVerticalApertureOffset(ds->GetTypedValue(0.0f) / GfCamera::APERTURE_UNIT);
+    }
+    if (HdFloatDataSourceHandle ds = cameraSchema.GetFocalLength())
+    {
+        camera.SetFocalLength(ds->GetTypedValue(0.0f) / GfCamera::FOCAL_LENGTH_UNIT);
+    }
+    if (HdVec2fDataSourceHandle ds = cameraSchema.GetClippingRange())
+    {
+        GfVec2f range = ds->GetTypedValue(0.0f);
+        camera.SetClippingRange(GfRange1f(range[0], range[1]));
+    }
+
+    GfMatrix4d toWorld(1.0);
+    if (HdMatrixDataSourceHandle xform = HdXformSchema::GetFromParent(myPrim.dataSource).GetMatrix())
+    {
+        toWorld = xform->GetTypedValue(0.0f);
+    }
+    GfMatrix4d fromWorld = toWorld.GetInverse();
+    GfFrustum frustum    = camera.GetFrustum();
+    auto primvar         = [&](TfToken const& name) { return primvars.GetPrimvar(name).GetPrimvarValue(); };
+
+    params.enabled         = true;
+    params.viewProjection  = toWorld * frustum.ComputeViewMatrix() * frustum.ComputeProjectionMatrix();
+    params.position        = fromWorld.Transform(frustum.GetPosition());
+    params.viewDirection   = fromWorld.TransformDir(frustum.ComputeViewDirection()).GetNormalized();
+    params.orthographic    = camera.GetProjection() == GfCamera::Orthographic;
+    params.margin          = getValue<float>(primvar(_tokens->cullingMargin), 0.0f, 0.0f);
+    params.backfaces       = getValue<bool>(primvar(_tokens->cullingBackfaces), 0.0f, true);
+    params.falloffDistance = getValue<float>(primvar(_tokens->cullingFalloffDistance), 0.0f, 0.0f);
+    return params;
 }
 
-class _CurveVertexCountsDataSource : public HdIntArrayDataSource
+// Pose the fur roots are spread over: the source mesh's rest primvar when authored, otherwise
+// its points at their first time sample, so the layout is the same whichever frame it is
+// first built at. A rest pose whose vertex count differs from the current points (varying
+// topology) gives way to the current points. An unchanged pose comes back as previous, so
+// the layout parameters keep comparing by identity. A pose read from the same data source
+// at the same sample times as previousSource and previousTimes is taken as unchanged
+// without comparing its points, which keeps deforming frames from doing so every time.
+VtVec3fArray
+getRestPoints(HdPrimvarsSchema& sourcePrimvars,
+              HdSampledDataSourceHandle const& points,
+              VtVec3fArray const& previous,
+              HdSampledDataSourceHandle* previousSource,
+              std::vector<HdSampledDataSource::Time>* previousTimes)
 {
-public:
-    HD_DECLARE_DATASOURCE(_CurveVertexCountsDataSource);
+    using Time           = HdSampledDataSource::Time;
+    VtVec3fArray current = getValue<VtVec3fArray>(points, 0.0f, VtVec3fArray());
+
+    auto cached = [&](HdSampledDataSourceHandle const& source, std::vector<Time> const& times) {
+        return source && source == *previousSource && times == *previousTimes && previous.size() == current.size();
+    };
+    auto resolved = [&](HdSampledDataSourceHandle const& source, std::vector<Time> times, VtVec3fArray rest) {
+        if (rest.size() != current.size())
+        {
+            // Follows the current points, so it cannot be cached by source.
+            rest            = current;
+            *previousSource = nullptr;
+            previousTimes->clear();
+        }
+        else
+        {
+            *previousSource = source;
+            *previousTimes  = std::move(times);
+        }
+        return rest == previous ? previous : rest;
+    };
 
-    bool GetContributingSampleTimesForInterval(Time startTime, Time endTime, std::vector<Time>* outSampleTimes) override
+    HdPrimvarSchema restPrimvar               = sourcePrimvars.GetPrimvar(_tokens->rest);
+    HdTokenDataSourceHandle restInterpolation = restPrimvar.GetInterpolation();
+    TfToken interpolation                     = restInterpolation ? restInterpolation->GetTypedValue(0.0f) : TfToken();
+    if (interpolation == HdPrimvarSchemaTokens->vertex || interpolation == HdPrimvarSchemaTokens->varying)
     {
-        return _faceVertexCountsDs->GetContributingSampleTimesForInterval(startTime, endTime, outSampleTimes) ||
-               _numSamplesDs->GetContributingSampleTimesForInterval(startTime, endTime, outSampleTimes);
+        HdSampledDataSourceHandle restValue = restPrimvar.GetPrimvarValue();
+        if (cached(restValue, {}))
+        {
+            return previous;
+        }
+        VtVec3fArray rest = getValue<VtVec3fArray>(restValue, 0.0f, VtVec3fArray());
+        if (!rest.empty())
+        {
+            return resolved(restValue, {}, rest);
+        }
     }
-    VtValue GetValue(Time shutterOffset) { return VtValue(GetTypedValue(shutterOffset)); }
-    VtIntArray GetTypedValue(Time shutterOffset)
+    if (!points)
     {
-        VtIntArray faceVertexCounts = _faceVertexCountsDs->GetValue(shutterOffset).UncheckedGet<VtIntArray>();
-        int numSamplesPerFace       = int(_numSamplesDs->GetValue(shutterOffset).GetWithDefault<float>(1.0));
-        int numSamples              = numSamplesPerFace * numQuadFaces(faceVertexCounts);
-        VtIntArray r(numSamples);
-        std::fill(r.begin(), r.end(), 2);
-        return r;
+        return resolved(nullptr, {}, VtVec3fArray());
+    }
+    std::vector<Time> times;
+    if (!points->GetContributingSampleTimesForInterval(
+            std::numeric_limits<Time>::lowest(), std::numeric_limits<Time>::max(), &times))
+    {
+        // Not animated, so every frame has the same points.
+        times.clear();
+    }
+    if (cached(points, times))
+    {
+        return previous;
     }
+    Time first = times.empty() ? 0.0f : *std::min_element(times.begin(), times.end());
+    return resolved(points, times, times.empty() ? current : getValue<VtVec3fArray>(points, first, VtVec3fArray()));
+}
 
-private:
-    _CurveVertexCountsDataSource(HdSampledDataSourceHandle faceVertexCountsDs, HdSampledDataSourceHandle numSamplesDs)
-        : _faceVertexCountsDs(faceVertexCountsDs)
-        , _numSamplesDs(numSamplesDs)
+// Area of the control cage of the rest pose, weighted by the density primvar like the
+// layout is. It decides how much of the maxCurves budget a source mesh gets.
+double
+restArea(VtVec3fArray const& rest, VtIntArray const& counts, VtIntArray const& indices, VtFloatArray const& density)
+{
+    bool useDensity = density.size() == counts.size();
+    double area     = 0.0;
+    size_t offset   = 0;
+    for (size_t face = 0; face < counts.size(); ++face)
+    {
+        int n = counts[face];
+        if (n < 0 || offset + size_t(n) > indices.size())
+        {
+            break;
+        }
+        GfVec3d normal(0.0);
+        for (int i = 0; i < n; ++i)
+        {
+            int a = indices[offset + i];
+            int b = indices[offset + (i + 1) % n];
+            if (a >= 0 && b >= 0 && size_t(a) < rest.size() && size_t(b) < rest.size())
+            {
+                normal += GfCross(GfVec3d(rest[a]), GfVec3d(rest[b]));
+            }
+        }
+        area += 0.5 * normal.GetLength() * (useDensity ? std::max(0.0, double(density[face])) : 1.0);
+        offset += size_t(n);
+    }
+    return area;
+}
+
+bool
+getContributingSampleTimes(std::initializer_list<HdSampledDataSourceHandle> dataSources,
+                           HdSampledDataSource::Time startTime,
+                           HdSampledDataSource::Time endTime,
+                           std::vector<HdSampledDataSource::Time>* outSampleTimes)
+{
+    bool varying = false;
+    for (HdSampledDataSourceHandle const& ds : dataSources)
     {
+        std::vector<HdSampledDataSource::Time> times;
+        if (ds && ds->GetContributingSampleTimesForInterval(startTime, endTime, &times))
+        {
+            outSampleTimes->insert(outSampleTimes->end(), times.begin(), times.end());
+            varying = true;
+        }
     }
-    HdSampledDataSourceHandle _faceVertexCountsDs, _numSamplesDs;
-};
+    std::sort(outSampleTimes->begin(), outSampleTimes->end());
+    outSampleTimes->erase(std::unique(outSampleTimes->begin(), outSampleTimes->end()), outSampleTimes->end());
+    return varying;
+}
 
-class _CurveIndicesFromDataSource : public HdIntArrayDataSource
+// Curve counts ("all 2s") and indices (iota) only depend on the number of curves, so all
+// data sources with the same count share one array.
+VtIntArray
+sharedCurveArray(size_t numCurves, bool indices)
 {
-public:
-    HD_DECLARE_DATASOURCE(_CurveIndicesFromDataSource);
+    static std::mutex mutex;
+    static std::map<std::pair<size_t, bool>, VtIntArray> arrays;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = arrays.find({ numCurves, indices });
+    if (it != arrays.end())
+    {
+        return it->second;
+    }
+    if (arrays.size() >= 16)
+    {
+        arrays.clear();
+    }
+    VtIntArray r(indices ? 2 * numCurves : numCurves);
+    if (indices)
+    {
+        std::iota(r.begin(), r.end(), 0);
+    }
+    else
+    {
+        std::fill(r.begin(), r.end(), 2);
+    }
+    return arrays[{ numCurves, indices }] = r;
+}
 
+class _CurveTopologyDataSource : public HdIntArrayDataSource
+{
+public:
     bool GetContributingSampleTimesForInterval(Time startTime, Time endTime, std::vector<Time>* outSampleTimes) override
     {
-        return _faceVertexCountsDs->GetContributingSampleTimesForInterval(startTime, endTime, outSampleTimes) ||
-               _numSamplesDs->GetContributingSampleTimesForInterval(startTime, endTime, outSampleTimes);
+        MyFurInputs inputs = _evaluator->GetInputs();
+        return getContributingSampleTimes(
+            { inputs.faceVertexCounts, inputs.numSamplesPerFace, inputs.maxCurves, inputs.density, inputs.childrenPerGuide },
+            startTime,
+            endTime,
+            outSampleTimes);
     }
     VtValue GetValue(Time shutterOffset) { return VtValue(GetTypedValue(shutterOffset)); }
     VtIntArray GetTypedValue(Time shutterOffset)
     {
-        VtIntArray faceVertexCounts = _faceVertexCountsDs->GetValue(shutterOffset).UncheckedGet<VtIntArray>();
-        int numSamplesPerFace       = int(_numSamplesDs->GetValue(shutterOffset).GetWithDefault<float>(1.0f));
-        int numSamples              = numSamplesPerFace * numQuadFaces(faceVertexCounts);
-        VtIntArray r(2 * numSamples);
-        std::iota(r.begin(), r.end(), 0);
-        return r;
+        VtIntArray result;
+        uint64_t generation = _memo.GetGeneration();
+        if (!_memo.Find(shutterOffset, &result))
+        {
+            result = sharedCurveArray(_evaluator->ComputeNumCurves(_shard, shutterOffset), _indices);
+            _memo.Store(shutterOffset, result, generation);
+        }
+        return result;
+    }
+    void Invalidate() { _memo.Clear(); }
+
+protected:
+    _CurveTopologyDataSource(std::shared_ptr<MyFurEvaluator> const& evaluator, int shard, bool indices)
+        : _evaluator(evaluator)
+        , _shard(shard)
+        , _indices(indices)
+    {
     }
 
 private:
-    _CurveIndicesFromDataSource(HdSampledDataSourceHandle faceVertexCountsDs, HdSampledDataSourceHandle numSamplesDs)
-        : _faceVertexCountsDs(faceVertexCountsDs)
-        , _numSamplesDs(numSamplesDs)
+    std::shared_ptr<MyFurEvaluator> _evaluator;
+    int _shard;
+    bool _indices;
+    TimeMemo<VtIntArray> _memo;
+};
+
+class _CurveVertexCountsDataSource : public _CurveTopologyDataSource
+{
+public:
+    HD_DECLARE_DATASOURCE(_CurveVertexCountsDataSource);
+
+private:
+    _CurveVertexCountsDataSource(std::shared_ptr<MyFurEvaluator> const& evaluator, int shard)
+        : _CurveTopologyDataSource(evaluator, shard, false)
+    {
+    }
+};
+
+class _CurveIndicesFromDataSource : public _CurveTopologyDataSource
+{
+public:
+    HD_DECLARE_DATASOURCE(_CurveIndicesFromDataSource);
+
+private:
+    _CurveIndicesFromDataSource(std::shared_ptr<MyFurEvaluator> const& evaluator, int shard)
+        : _CurveTopologyDataSource(evaluator, shard, true)
     {
     }
-    HdSampledDataSourceHandle _faceVertexCountsDs, _numSamplesDs;
 };
 
 class _CurvePointsFromMeshPointDataSource : public HdVec3fArrayDataSource
@@ -128,136 +455,85 @@ public:
 
     bool GetContributingSampleTimesForInterval(Time startTime, Time endTime, std::vector<Time>* outSampleTimes) override
     {
-        return _pointsDs->GetContributingSampleTimesForInterval(startTime, endTime, outSampleTimes);
+        MyFurInputs inputs = _evaluator->GetInputs();
+        if (!getContributingSampleTimes({ inputs.points, inputs.length, inputs.clump }, startTime, endTime, outSampleTimes))
+        {
+            return false;
+        }
+        // The caller is about to ask for each of these samples, so evaluate them together now.
+        _Prefetch(inputs, *outSampleTimes, startTime, endTime);
+        return true;
     }
     VtValue GetValue(Time shutterOffset) { return VtValue(GetTypedValue(shutterOffset)); }
     VtVec3fArray GetTypedValue(Time shutterOffset)
     {
-        if (!_faceVertexCountsDs || !_faceIndicesDs || !_pointsDs)
-        {
-            return VtVec3fArray();
-        }
-
-        VtIntArray faceVertexCounts = _faceVertexCountsDs->GetValue(shutterOffset).UncheckedGet<VtIntArray>();
-        VtIntArray faceIndices      = _faceIndicesDs->GetValue(shutterOffset).UncheckedGet<VtIntArray>();
-        VtVec3fArray points         = _pointsDs->GetValue(shutterOffset).UncheckedGet<VtVec3fArray>();
-        int numSamples              = int(_numSamplesDs->GetValue(shutterOffset).GetWithDefault<float>(1.0f));
-        float length                = _lengthDs->GetValue(shutterOffset).GetWithDefault<float>(0.1f);
-
-        if (_faceIndices != faceIndices)
+        VtVec3fArray result;
+        uint64_t generation = _memo.GetGeneration();
+        if (!_memo.Find(shutterOffset, &result))
         {
-            _CreateRefiner(faceVertexCounts, faceIndices, points);
+            bool evaluated;
+            _evaluator->Evaluate(_shard, 1, &shutterOffset, &result, &evaluated);
+            _memo.Store(shutterOffset, result, generation);
         }
+        return result;
+    }
+    void Invalidate() { _memo.Clear(); }
 
-        int nRefinerVertices = _refiner->GetNumVerticesTotal();
-        int nLocalPoints     = _patchTable->GetNumLocalPoints();
-        std::vector<Vertex> verts(nRefinerVertices + nLocalPoints);
-        std::memcpy(&verts[0], points.cdata(), points.size() * 3 * sizeof(float));
-        int nRefinedLevels = _refiner->GetNumLevels();
-        OpenSubdiv::Far::PrimvarRefinerReal<float> primvarRefiner(*_refiner);
+private:
+    _CurvePointsFromMeshPointDataSource(std::shared_ptr<MyFurEvaluator> const& evaluator, int shard)
+        : _evaluator(evaluator)
+        , _shard(shard)
+    {
+    }
 
-        Vertex* src = &verts[0];
-        for (int level = 1; level < nRefinedLevels; ++level)
+    void _Prefetch(MyFurInputs const& inputs, std::vector<Time> const& sampleTimes, Time startTime, Time endTime)
+    {
+        uint64_t generation = _memo.GetGeneration();
+        TfSmallVector<Time, MyFurEvaluator::MaxTimes> times;
+        VtVec3fArray cached;
+        for (Time time : sampleTimes)
         {
-            Vertex* dst = src + _refiner->GetLevel(level - 1).GetNumVertices();
-            primvarRefiner.Interpolate(level, src, dst);
-            src = dst;
+            if (times.size() < MyFurEvaluator::MaxTimes && !_memo.Find(time, &cached))
+            {
+                times.push_back(time);
+            }
         }
-        if (nLocalPoints)
+        // A batch shares one layout, which only holds if nothing that moves the roots varies
+        // over the shutter; otherwise every sample goes through GetValue on its own.
+        std::vector<Time> layoutTimes;
+        if (times.size() < 2 || getContributingSampleTimes({ inputs.faceVertexCounts,
+                                                              inputs.faceIndices,
+                                                              inputs.density,
+                                                              inputs.numSamplesPerFace,
+                                                              inputs.maxCurves,
+                                                              inputs.childrenPerGuide },
+                                                            startTime,
+                                                            endTime,
+                                                            &layoutTimes))
         {
-            _patchTable->GetLocalPointStencilTable<float>()->UpdateValues(&verts[0], &verts[nRefinerVertices]);
+            return;
         }
-        OpenSubdiv::Far::PatchMap patchmap(*_patchTable);
-        int nfaces = numQuadFaces(faceVertexCounts);
-        std::vector<LimitFrame> samples(numSamples * nfaces);
-        srand(static_cast<int>(1));
-        float pWeights[20], dsWeights[20], dtWeights[20];
-
-        for (int face = 0, count = 0; face < nfaces; ++face)
+        VtVec3fArray results[MyFurEvaluator::MaxTimes];
+        bool evaluated[MyFurEvaluator::MaxTimes];
+        _evaluator->Evaluate(_shard, times.size(), times.data(), results, evaluated);
+        for (size_t i = 0; i < times.size(); ++i)
         {
-            for (int sample = 0; sample < numSamples; ++sample, ++count)
+            if (evaluated[i])
             {
-                float s = (float)rand() / (float)RAND_MAX;
-                float t = (float)rand() / (float)RAND_MAX;
-
-                OpenSubdiv::Far::PatchTable::PatchHandle const* handle = patchmap.FindPatch(face, s, t);
-                // ܂ŃLbV
-                _patchTable->EvaluateBasis(*handle, s, t, pWeights, dsWeights, dtWeights);
-                OpenSubdiv::Far::ConstIndexArray cvs = _patchTable->GetPatchVertices(*handle);
-                LimitFrame& dst                      = samples[count];
-                dst.Clear();
-                for (int cv = 0; cv < cvs.size(); ++cv)
-                {
-                    dst.AddWithWeight(verts[cvs[cv]], pWeights[cv], dsWeights[cv], dtWeights[cv]);
-                }
+                _memo.Store(times[i], results[i], generation);
             }
         }
-
-        VtVec3fArray r;
-        r.reserve(samples.size() * 2);
-        for (size_t i = 0; i < samples.size(); ++i)
-        {
-            GfVec3f n = samples[i].deriv1 ^ samples[i].deriv2;
-            n.Normalize();
-            r.emplace_back(samples[i].point);
-            r.emplace_back(samples[i].point + length * n);
-        }
-        return r;
-    }
-    void Update(HdSampledDataSourceHandle pointsDs,
-                HdSampledDataSourceHandle faceVertexCountsDs,
-                HdSampledDataSourceHandle faceIndicesDs,
-                HdSampledDataSourceHandle numSampleDs,
-                HdSampledDataSourceHandle lengthDs)
-    {
-        _pointsDs           = pointsDs;
-        _faceVertexCountsDs = faceVertexCountsDs;
-        _faceIndicesDs      = faceIndicesDs;
-        _numSamplesDs       = numSampleDs;
-        _lengthDs           = lengthDs;
     }
 
-private:
-    _CurvePointsFromMeshPointDataSource() {}
-    void _CreateRefiner(VtIntArray const& faceVertexCounts, VtIntArray const& faceIndices, VtVec3fArray const& points)
-    {
-        using namespace OpenSubdiv;
-        _faceIndices = faceIndices;
-
-        using Descriptor     = Far::TopologyDescriptor;
-        Sdc::SchemeType type = Sdc::SCHEME_CATMARK;
-        Sdc::Options options;
-        options.SetVtxBoundaryInterpolation(Sdc::Options::VTX_BOUNDARY_EDGE_ONLY);
-        Descriptor desc;
-        desc.numVertices        = (int)points.size();
-        desc.numFaces           = (int)faceVertexCounts.size();
-        desc.numVertsPerFace    = faceVertexCounts.cdata();
-        desc.vertIndicesPerFace = faceIndices.cdata();
-        _refiner.reset(Far::TopologyRefinerFactory<Descriptor>::Create(
-            desc, Far::TopologyRefinerFactory<Descriptor>::Options(type, options)));
-
-        Far::PatchTableFactory::Options patchOptions;
-        patchOptions.SetPatchPrecision<float>();
-        patchOptions.useInfSharpPatch      = true;
-        patchOptions.generateVaryingTables = false;
-        patchOptions.endCapType            = Far::PatchTableFactory::Options::ENDCAP_GREGORY_BASIS;
-
-        int isolateLevel = 3;
-        Far::TopologyRefiner::AdaptiveOptions adaptiveOptions(isolateLevel);
-        adaptiveOptions = patchOptions.GetRefineAdaptiveOptions();
-        _refiner->RefineAdaptive(adaptiveOptions);
-        _patchTable.reset(Far::PatchTableFactory::Create(*_refiner, patchOptions));
-    }
-
-    HdSampledDataSourceHandle _pointsDs, _faceVertexCountsDs, _faceIndicesDs, _numSamplesDs, _lengthDs;
-    std::unique_ptr<OpenSubdiv::Far::TopologyRefiner> _refiner     = nullptr;
-    std::unique_ptr<OpenSubdiv::Far::PatchTable const> _patchTable = nullptr;
-    VtIntArray _faceIndices;
+    std::shared_ptr<MyFurEvaluator> _evaluator;
+    int _shard;
+    TimeMemo<VtVec3fArray> _memo;
 };
 } // namespace
 
 MyProceduralFur::MyProceduralFur(const SdfPath& proceduralPrimPath)
     : HdGpGenerativeProcedural(proceduralPrimPath)
+    , _stats(std::make_shared<MyProceduralStats>("MyProceduralFur"))
 {
 }
 
@@ -273,18 +549,19 @@ MyProceduralFur::UpdateDependencies(const HdSceneIndexBaseRefPtr& inputScene)
     DependencyMap result;
     HdSceneIndexPrim myPrim   = inputScene->GetPrim(_GetProceduralPrimPath());
     HdPrimvarsSchema primvars = HdPrimvarsSchema::GetFromParent(myPrim.dataSource);
-    if (HdSampledDataSourceHandle sourceMeshDs = primvars.GetPrimvar(_tokens->sourceMeshPath).GetPrimvarValue())
+    for (SdfPath const& sourceMeshPath : getTargetPaths(primvars.GetPrimvar(_tokens->sourceMeshPath).GetPrimvarValue()))
     {
-        VtValue v = sourceMeshDs->GetValue(0.0f);
-        if (v.IsHolding<VtArray<SdfPath>>())
-        {
-            VtArray<SdfPath> a = v.UncheckedGet<VtArray<SdfPath>>();
-            if (a.size() == 1)
-            {
-                result[a[0]] = HdDataSourceLocatorSet{ HdMeshTopologySchema::GetDefaultLocator(),
-                                                       HdPrimvarsSchema::GetPointsLocator() };
-            }
-        }
+        result[sourceMeshPath] = HdDataSourceLocatorSet{ HdMeshTopologySchema::GetDefaultLocator(),
+                                                         HdPrimvarsSchema::GetPointsLocator(),
+                                                         HdPrimvarsSchema::GetDefaultLocator().Append(_tokens->density),
+                                                         HdPrimvarsSchema::GetDefaultLocator().Append(_tokens->rest) };
+    }
+    // The culling camera's lens and transform decide which curves are generated.
+    std::vector<SdfPath> cameraPaths = getTargetPaths(primvars.GetPrimvar(_tokens->cullingCamera).GetPrimvarValue());
+    if (!cameraPaths.empty())
+    {
+        result[cameraPaths[0]].insert(HdCameraSchema::GetDefaultLocator());
+        result[cameraPaths[0]].insert(HdXformSchema::GetDefaultLocator());
     }
     return result;
 }
@@ -295,68 +572,383 @@ MyProceduralFur::Update(const HdSceneIndexBaseRefPtr& inputScene,
                         const DependencyMap& dirtiedDependencies,
                         HdSceneIndexObserver::DirtiedPrimEntries* outputDirtiedPrims)
 {
+    TRACE_FUNCTION();
     ChildPrimTypeMap result;
     HdSceneIndexPrim myPrim   = inputScene->GetPrim(_GetProceduralPrimPath());
     HdPrimvarsSchema primvars = HdPrimvarsSchema::GetFromParent(myPrim.dataSource);
 
-    SdfPath sourceMeshPath;
-    if (HdSampledDataSourceHandle sourceMeshDs = primvars.GetPrimvar(_tokens->sourceMeshPath).GetPrimvarValue())
+    // Parameters shared by every source mesh. maxCurves is split between the meshes below;
+    // the shard counts apply per mesh.
+    MyFurInputs common;
+    common.numSamplesPerFace = primvars.GetPrimvar(_tokens->numSamplesPerFace).GetPrimvarValue();
+    common.length            = primvars.GetPrimvar(_tokens->length).GetPrimvarValue();
+    common.maxCurves         = primvars.GetPrimvar(_tokens->maxCurves).GetPrimvarValue();
+    common.childrenPerGuide  = primvars.GetPrimvar(_tokens->childrenPerGuide).GetPrimvarValue();
+    common.clump             = primvars.GetPrimvar(_tokens->clump).GetPrimvarValue();
+    common.quality           = primvars.GetPrimvar(_tokens->quality).GetPrimvarValue();
+    common.lookAheadFrames   = primvars.GetPrimvar(_tokens->lookAheadFrames).GetPrimvarValue();
+    common.culling           = getCullingParams(inputScene, myPrim, primvars);
+    int numShards            = getCount(primvars.GetPrimvar(_tokens->numShards).GetPrimvarValue(), 0.0f, 0);
+    int curvesPerShard       = getCount(primvars.GetPrimvar(_tokens->curvesPerShard).GetPrimvarValue(), 0.0f, 0);
+
+    // Each source mesh keeps its own evaluator (refiner, layout and stencil caches) and
+    // shards. Meshes that are no longer sourced take their children with them.
+    std::vector<SdfPath> sourceMeshPaths = getTargetPaths(primvars.GetPrimvar(_tokens->sourceMeshPath).GetPrimvarValue());
+    for (auto it = _sources.begin(); it != _sources.end();)
+    {
+        bool sourced = std::find(sourceMeshPaths.begin(), sourceMeshPaths.end(), it->first) != sourceMeshPaths.end();
+        it           = sourced ? std::next(it) : _sources.erase(it);
+    }
+    std::vector<_Source*> sources;
+    for (size_t i = 0; i < sourceMeshPaths.size(); ++i)
+    {
+        _Source& source = _sources[sourceMeshPaths[i]];
+        // A single mesh keeps the child names it always had.
+        source.childPrefix = sourceMeshPaths.size() == 1 ? std::string() : TfStringPrintf("mesh_%zu", i);
+        sources.push_back(&source);
+    }
+
+    // Meshes are independent, so they are resolved and brought up to date in parallel; one
+    // that is neither dirtied nor affected by a parameter change does no work.
+    bool weighBudget = sources.size() > 1 && getCount(common.maxCurves, 0.0f, 0) > 0;
+    std::vector<MyFurInputs> inputs(sources.size());
+    WorkParallelForN(sources.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            inputs[i] = _ResolveSource(inputScene, sourceMeshPaths[i], common, weighBudget, dirtiedDependencies, sources[i]);
+        }
+    });
+    // maxCurves stays a budget for the whole procedural: each mesh gets a share by the area
+    // of its rest pose times density, or an equal share when none has any area.
+    if (weighBudget)
+    {
+        double total = 0.0;
+        for (_Source const* source : sources)
+        {
+            total += source->budgetWeight;
+        }
+        double cumulative = 0.0;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            inputs[i].budgetBegin = cumulative;
+            cumulative += total > 0.0 ? sources[i]->budgetWeight / total : 1.0 / double(sources.size());
+            inputs[i].budgetEnd = i + 1 == sources.size() ? 1.0 : std::min(cumulative, 1.0);
+        }
+    }
+    WorkParallelForN(sources.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            _UpdateSource(sourceMeshPaths[i], inputs[i], numShards, curvesPerShard, dirtiedDependencies, sources[i]);
+        }
+    });
+
+    _shards.clear();
+    for (_Source const* source : sources)
     {
-        VtValue v = sourceMeshDs->GetValue(0.0f);
-        if (v.IsHolding<VtArray<SdfPath>>())
+        for (_Shard const& shard : source->shards)
         {
-            VtArray<SdfPath> a = v.UncheckedGet<VtArray<SdfPath>>();
-            if (a.size() == 1)
+            result[shard.path]  = HdPrimTypeTokens->basisCurves;
+            _shards[shard.path] = shard;
+            // A newly added child is pulled in full anyway.
+            bool isNew = previousResult.find(shard.path) == previousResult.end();
+            if (!source->moved[shard.index] || !outputDirtiedPrims || isNew)
+            {
+                continue;
+            }
+            HdDataSourceLocatorSet locators;
+            locators.append(HdPrimvarsSchema::GetPointsLocator());
+            if (source->topologyDirty)
             {
-                sourceMeshPath = a[0];
+                locators.append(HdBasisCurvesTopologySchema::GetDefaultLocator());
             }
+            outputDirtiedPrims->emplace_back(shard.path, locators);
         }
     }
-    if (sourceMeshPath.IsEmpty())
-        return result;
 
+    // The counters change with every evaluation, so an opted-in stats prim is always dirty.
+    _statsEnabled = getValue<bool>(primvars.GetPrimvar(_tokens->stats).GetPrimvarValue(), 0.0f, false);
+    if (_statsEnabled)
+    {
+        SdfPath statsPath = _GetProceduralPrimPath().AppendChild(_tokens->stats);
+        result[statsPath] = TfToken();
+        if (outputDirtiedPrims && previousResult.find(statsPath) != previousResult.end())
+        {
+            outputDirtiedPrims->emplace_back(statsPath, HdDataSourceLocatorSet{ HdDataSourceLocator(_tokens->stats) });
+        }
+    }
+
+    return result;
+}
+
+MyFurInputs
+MyProceduralFur::_ResolveSource(const HdSceneIndexBaseRefPtr& inputScene,
+                                const SdfPath& sourceMeshPath,
+                                MyFurInputs const& common,
+                                bool weighBudget,
+                                const DependencyMap& dirtiedDependencies,
+                                _Source* source)
+{
+    TRACE_FUNCTION();
     HdSceneIndexPrim sourceMeshPrim     = inputScene->GetPrim(sourceMeshPath);
     HdPrimvarsSchema sourcePrimvars     = HdPrimvarsSchema::GetFromParent(sourceMeshPrim.dataSource);
     HdMeshTopologySchema sourceTopology = HdMeshSchema::GetFromParent(sourceMeshPrim.dataSource).GetTopology();
 
-    _meshPointsDs           = sourcePrimvars.GetPrimvar(HdPrimvarsSchemaTokens->points).GetPrimvarValue();
-    _meshFaceVertexCountsDs = sourceTopology.GetFaceVertexCounts();
-    _meshFaceIndicesDs      = sourceTopology.GetFaceVertexIndices();
-    _numSampleDs            = primvars.GetPrimvar(_tokens->numSamplesPerFace).GetPrimvarValue();
-    _lengthDs               = primvars.GetPrimvar(_tokens->length).GetPrimvarValue();
+    MyFurInputs inputs      = common;
+    inputs.points           = sourcePrimvars.GetPrimvar(HdPrimvarsSchemaTokens->points).GetPrimvarValue();
+    inputs.faceVertexCounts = sourceTopology.GetFaceVertexCounts();
+    inputs.faceIndices      = sourceTopology.GetFaceVertexIndices();
 
-    SdfPath path      = _GetProceduralPrimPath();
-    SdfPath childPath = path.AppendChild(_tokens->child); // Hydra Rprim 
+    // Density weights faces of the source mesh, so only a uniform primvar is meaningful.
+    HdPrimvarSchema densityPrimvar               = sourcePrimvars.GetPrimvar(_tokens->density);
+    HdTokenDataSourceHandle densityInterpolation = densityPrimvar.GetInterpolation();
+    if (densityInterpolation && densityInterpolation->GetTypedValue(0.0f) == HdPrimvarSchemaTokens->uniform)
+    {
+        inputs.density = densityPrimvar.GetPrimvarValue();
+    }
 
-    // ̃Tvł̓LbV͖ŖSĂ邪A{͌ʂɍXVǗׂ
-    result[childPath] = HdPrimTypeTokens->basisCurves;
-    if (outputDirtiedPrims)
+    // The rest pose only needs resolving again when the mesh or its rest primvar changed.
+    auto dirtied   = dirtiedDependencies.find(sourceMeshPath);
+    bool restDirty = !source->evaluator;
+    if (dirtied != dirtiedDependencies.end())
     {
-        HdDataSourceLocatorSet locators;
-        locators.append(HdPrimvarsSchema::GetPointsLocator());
-        locators.append(HdBasisCurvesTopologySchema::GetDefaultLocator());
-        outputDirtiedPrims->emplace_back(childPath, locators);
+        restDirty |= dirtied->second.Intersects(HdMeshTopologySchema::GetDefaultLocator()) ||
+                     dirtied->second.Intersects(HdPrimvarsSchema::GetPointsLocator()) ||
+                     dirtied->second.Intersects(HdPrimvarsSchema::GetDefaultLocator().Append(_tokens->rest));
     }
+    inputs.rest = restDirty ? getRestPoints(
+                                  sourcePrimvars, inputs.points, source->rest, &source->restSource, &source->restTimes)
+                            : source->rest;
 
-    return result;
+    // An unchanged rest pose comes back as the same array, so the weight is usually reused.
+    if (weighBudget)
+    {
+        VtIntArray counts    = inputs.GetFaceVertexCounts(0.0f);
+        VtIntArray indices   = inputs.GetFaceIndices(0.0f);
+        VtFloatArray density = getValue<VtFloatArray>(inputs.density, 0.0f, VtFloatArray());
+        if (!source->budgetRest.IsIdentical(inputs.rest) || !source->budgetCounts.IsIdentical(counts) ||
+            !source->budgetIndices.IsIdentical(indices) || !source->budgetDensity.IsIdentical(density))
+        {
+            source->budgetWeight  = restArea(inputs.rest, counts, indices, density);
+            source->budgetRest    = inputs.rest;
+            source->budgetCounts  = counts;
+            source->budgetIndices = indices;
+            source->budgetDensity = density;
+        }
+    }
+    return inputs;
+}
+
+void
+MyProceduralFur::_UpdateSource(const SdfPath& sourceMeshPath,
+                               MyFurInputs const& inputs,
+                               int numShards,
+                               int curvesPerShard,
+                               const DependencyMap& dirtiedDependencies,
+                               _Source* source)
+{
+    TRACE_FUNCTION();
+    auto dirtied = dirtiedDependencies.find(sourceMeshPath);
+
+    // Shards are either counted directly or sized by a curve budget, and never split a slice.
+    MyFurLayoutParams params    = inputs.GetLayoutParams(0.0f);
+    VtIntArray faceVertexCounts = inputs.GetFaceVertexCounts(0.0f);
+    int numGuides               = MyFurLayout::ComputeNumGuides(faceVertexCounts, params);
+    int numCurves               = numGuides * (1 + std::max(0, params.childrenPerGuide));
+    if (numShards <= 0 && curvesPerShard > 0)
+    {
+        numShards = int((int64_t(numCurves) + curvesPerShard - 1) / curvesPerShard);
+    }
+    int numSlices = (numGuides + MyFurStencils::SliceWidth - 1) / MyFurStencils::SliceWidth;
+    numShards     = std::clamp(numShards, 1, std::max(1, numSlices));
+
+    // Work out what actually changed: deformation only moves the points, a new length only
+    // changes the tips, and the curve topology follows the layout parameters, the mesh topology
+    // and how the curves are split into shards. The quality tier moves the roots but keeps
+    // the curve count.
+    float length                      = inputs.GetLength(0.0f);
+    float clump                       = inputs.GetClump(0.0f);
+    MyTopologyOptions topologyOptions = inputs.GetTopologyOptions(0.0f);
+
+    bool renamed       = source->shardPrefix != source->childPrefix;
+    bool topologyDirty = !source->evaluator || params != source->params || numShards != source->numShards || renamed;
+    bool pointsDirty   = topologyDirty || length != source->length || clump != source->clump ||
+                       topologyOptions != source->topologyOptions;
+    bool pointsMoved   = false;
+    if (dirtied != dirtiedDependencies.end())
+    {
+        topologyDirty |= dirtied->second.Intersects(HdMeshTopologySchema::GetDefaultLocator());
+        pointsDirty |= topologyDirty;
+        pointsMoved = dirtied->second.Intersects(HdPrimvarsSchema::GetPointsLocator());
+    }
+    // Culling picks the curves by the camera, the points and the length, so with culling on
+    // anything that moves the curves may also change how many there are, in any shard.
+    if (inputs.culling != source->culling)
+    {
+        topologyDirty = true;
+        pointsDirty   = true;
+    }
+    if (inputs.culling.enabled && (pointsDirty || pointsMoved))
+    {
+        topologyDirty = true;
+        pointsDirty   = true;
+    }
+
+    if (!source->evaluator)
+    {
+        source->evaluator = std::make_shared<MyFurEvaluator>(_stats);
+        source->evaluator->SetAsync(_async);
+    }
+    // A deformation only dirties the shards whose curves read a control vertex that moved.
+    // Shards are told apart by the points at time 0; other shutter samples are assumed to
+    // follow them.
+    VtVec3fArray points = inputs.GetPoints(0.0f);
+    source->moved.assign(numShards, pointsDirty || pointsMoved);
+    if (!pointsDirty && pointsMoved && !source->evaluator->FindMovedShards(source->points, points, &source->moved))
+    {
+        source->moved.assign(numShards, true);
+    }
+    if (pointsDirty || pointsMoved)
+    {
+        source->evaluator->Invalidate();
+    }
+    source->evaluator->SetInputs(inputs, numShards);
+    if (topologyDirty || pointsDirty)
+    {
+        source->evaluator->RequestLayout(0.0f);
+    }
+    // Every new frame (or edit) restarts the look-ahead from there.
+    if (pointsDirty || pointsMoved)
+    {
+        source->evaluator->StartLookAhead();
+    }
+
+    source->params          = params;
+    source->length          = length;
+    source->clump           = clump;
+    source->topologyOptions = topologyOptions;
+    source->culling         = inputs.culling;
+    source->rest            = inputs.rest;
+    source->points          = points;
+    source->topologyDirty   = topologyDirty;
+
+    // The data sources persist across updates so their per-time results survive until
+    // their inputs are dirtied.
+    if (numShards != source->numShards || renamed)
+    {
+        SdfPath path           = _GetProceduralPrimPath();
+        std::string const& pre = source->childPrefix;
+        source->shards.resize(numShards);
+        for (int shard = 0; shard < numShards; ++shard)
+        {
+            std::string name;
+            if (numShards == 1)
+            {
+                name = pre.empty() ? _tokens->child.GetString() : pre; // Hydra Rprim 
+            }
+            else
+            {
+                name = TfStringPrintf("%s%sshard_%d", pre.c_str(), pre.empty() ? "" : "_", shard);
+            }
+            _Shard& s             = source->shards[shard];
+            s.path                = path.AppendChild(TfToken(name));
+            s.index               = shard;
+            s.curvePointsDs       = _CurvePointsFromMeshPointDataSource::New(source->evaluator, shard);
+            s.curveVertexCountsDs = _CurveVertexCountsDataSource::New(source->evaluator, shard);
+            s.curveIndicesDs      = _CurveIndicesFromDataSource::New(source->evaluator, shard);
+        }
+        source->numShards   = numShards;
+        source->shardPrefix = source->childPrefix;
+    }
+
+    for (_Shard const& shard : source->shards)
+    {
+        if (!source->moved[shard.index])
+        {
+            continue;
+        }
+        _CurvePointsFromMeshPointDataSource::Cast(shard.curvePointsDs)->Invalidate();
+        if (topologyDirty)
+        {
+            _CurveVertexCountsDataSource::Cast(shard.curveVertexCountsDs)->Invalidate();
+            _CurveIndicesFromDataSource::Cast(shard.curveIndicesDs)->Invalidate();
+        }
+    }
+}
+
+#if PXR_VERSION >= 2302
+bool
+MyProceduralFur::AsyncBegin(bool asyncEnabled)
+{
+    _async = asyncEnabled;
+    for (auto& entry : _sources)
+    {
+        entry.second.evaluator->SetAsync(asyncEnabled);
+        entry.second.evaluator->RequestLayout(0.0f);
+    }
+    // Polling is a flag check, so the procedural stays registered for later rebuilds too.
+    return asyncEnabled;
+}
+
+HdGpGenerativeProcedural::AsyncState
+MyProceduralFur::AsyncUpdate(const ChildPrimTypeMap& previousResult,
+                             ChildPrimTypeMap* outputPrimTypes,
+                             HdSceneIndexObserver::DirtiedPrimEntries* outputDirtiedPrims)
+{
+    bool changed = false;
+    for (auto& entry : _sources)
+    {
+        _Source& source = entry.second;
+        if (!source.evaluator->PollLayoutBuild())
+        {
+            continue;
+        }
+        TRACE_SCOPE("Pick up layout build");
+        // The new layout moves the roots of every shard but keeps their curve counts, unless
+        // culling picks the curves.
+        bool culled = source.evaluator->GetInputs().culling.enabled;
+        for (_Shard const& shard : source.shards)
+        {
+            _CurvePointsFromMeshPointDataSource::Cast(shard.curvePointsDs)->Invalidate();
+            HdDataSourceLocatorSet locators{ HdPrimvarsSchema::GetPointsLocator() };
+            if (culled)
+            {
+                _CurveVertexCountsDataSource::Cast(shard.curveVertexCountsDs)->Invalidate();
+                _CurveIndicesFromDataSource::Cast(shard.curveIndicesDs)->Invalidate();
+                locators.append(HdBasisCurvesTopologySchema::GetDefaultLocator());
+            }
+            if (outputDirtiedPrims && previousResult.find(shard.path) != previousResult.end())
+            {
+                outputDirtiedPrims->emplace_back(shard.path, locators);
+            }
+        }
+        changed = true;
+    }
+    if (!changed)
+    {
+        return Continuing;
+    }
+    *outputPrimTypes = previousResult;
+    return ContinuingWithNewChanges;
 }
+#endif
 
 HdSceneIndexPrim
 MyProceduralFur::GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const SdfPath& childPrimPath)
 {
+    TRACE_FUNCTION();
     HdSceneIndexPrim result;
 
-    if (!_curvePointsDs)
+    // Only the stats child Update returned, while it is enabled.
+    if (_statsEnabled && childPrimPath == _GetProceduralPrimPath().AppendChild(_tokens->stats))
     {
-        _curvePointsDs = _CurvePointsFromMeshPointDataSource::New();
+        result.dataSource = HdRetainedContainerDataSource::New(_tokens->stats, MyProceduralStats::GetDataSource(_stats));
+        return result;
     }
-    _CurvePointsFromMeshPointDataSource::Cast(_curvePointsDs)
-        ->Update(_meshPointsDs, _meshFaceVertexCountsDs, _meshFaceIndicesDs, _numSampleDs, _lengthDs);
-
-    // Refiner ȊÕg|Wˑ𖈉Ă͖̂ʂɎv̂ŁAǂɂ
 
-    if (_meshPointsDs)
+    auto it = _shards.find(childPrimPath);
+    if (it != _shards.end())
     {
+        _Shard const& shard = it->second;
         // meshPointDs _ɃC𐶐
         result.primType   = HdPrimTypeTokens->basisCurves;
         result.dataSource = HdRetainedContainerDataSource::New(
@@ -364,8 +956,8 @@ MyProceduralFur::GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const Sd
             HdBasisCurvesSchema::Builder()
                 .SetTopology(
                     HdBasisCurvesTopologySchema::Builder()
-                        .SetCurveVertexCounts(_CurveVertexCountsDataSource::New(_meshFaceVertexCountsDs, _numSampleDs))
-                        .SetCurveIndices(_CurveIndicesFromDataSource::New(_meshFaceVertexCountsDs, _numSampleDs))
+                        .SetCurveVertexCounts(shard.curveVertexCountsDs)
+                        .SetCurveIndices(shard.curveIndicesDs)
                         .SetBasis(HdRetainedTypedSampledDataSource<TfToken>::New(HdTokens->bezier))
                         .SetType(HdRetainedTypedSampledDataSource<TfToken>::New(HdTokens->linear))
                         .SetWrap(HdRetainedTypedSampledDataSource<TfToken>::New(HdTokens->segmented))
@@ -375,7 +967,7 @@ MyProceduralFur::GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const Sd
             HdRetainedContainerDataSource::New(
                 HdPrimvarsSchemaTokens->points,
                 HdPrimvarSchema::Builder()
-                    .SetPrimvarValue(_curvePointsDs)
+                    .SetPrimvarValue(shard.curvePointsDs)
                     .SetInterpolation(HdPrimvarSchema::BuildInterpolationDataSource(HdPrimvarSchemaTokens->vertex))
                     .SetRole(HdPrimvarSchema::BuildRoleDataSource(HdPrimvarSchemaTokens->point))
                     .Build(),
@@ -1,7 +1,16 @@
 #pragma once
 
+#include "gp_furEvaluator.h"
+#include "gp_stats.h"
+
+#include <pxr/base/vt/types.h>
 #include <pxr/imaging/hdGp/generativeProcedural.h>
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 class MyProceduralFur : public HdGpGenerativeProcedural
@@ -19,9 +28,72 @@ public:
 
     HdSceneIndexPrim GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const SdfPath& childPrimPath) override;
 
+#if PXR_VERSION >= 2302
+    // Topology rebuilds run in the background while the preview layout is shown; once a
+    // build is picked up here, the shards' points are dirtied.
+    bool AsyncBegin(bool asyncEnabled) override;
+    AsyncState AsyncUpdate(const ChildPrimTypeMap& previousResult,
+                           ChildPrimTypeMap* outputPrimTypes,
+                           HdSceneIndexObserver::DirtiedPrimEntries* outputDirtiedPrims) override;
+#endif
+
 private:
-    HdSampledDataSourceHandle _meshPointsDs, _meshFaceVertexCountsDs, _meshFaceIndicesDs, _numSampleDs, _lengthDs;
-    HdSampledDataSourceHandle _curvePointsDs;
+    struct _Shard
+    {
+        SdfPath path;
+        int index = 0;
+        HdSampledDataSourceHandle curvePointsDs, curveVertexCountsDs, curveIndicesDs;
+    };
+
+    // One source mesh: its evaluator (refiner, layout and stencil caches), its shards and
+    // what the last Update saw, to tell what changed.
+    struct _Source
+    {
+        std::string childPrefix; // "mesh_<i>", empty when it is the only source
+        std::string shardPrefix; // childPrefix the shards were named with
+        MyFurLayoutParams params;
+        float length  = 0.0f;
+        float clump   = 0.0f;
+        MyTopologyOptions topologyOptions;
+        MyFurCullingParams culling;
+        VtVec3fArray rest;
+        // Data source and sample times rest was read from; null when it followed the
+        // current points.
+        HdSampledDataSourceHandle restSource;
+        std::vector<HdSampledDataSource::Time> restTimes;
+        // Weight of the mesh in the procedural's maxCurves budget and the arrays it was
+        // computed from.
+        VtVec3fArray budgetRest;
+        VtIntArray budgetCounts, budgetIndices;
+        VtFloatArray budgetDensity;
+        double budgetWeight = 0.0;
+        int numShards       = 0;
+        // Points at time 0 as of the last Update, to tell which shards a deformation touches.
+        VtVec3fArray points;
+        std::vector<bool> moved; // per shard, kept across updates
+        bool topologyDirty = false;
+        std::shared_ptr<MyFurEvaluator> evaluator;
+        std::vector<_Shard> shards;
+    };
+
+    MyFurInputs _ResolveSource(const HdSceneIndexBaseRefPtr& inputScene,
+                               const SdfPath& sourceMeshPath,
+                               MyFurInputs const& common,
+                               bool weighBudget,
+                               const DependencyMap& dirtiedDependencies,
+                               _Source* source);
+    void _UpdateSource(const SdfPath& sourceMeshPath,
+                       MyFurInputs const& inputs,
+                       int numShards,
+                       int curvesPerShard,
+                       const DependencyMap& dirtiedDependencies,
+                       _Source* source);
+
+    bool _async = false;
+    MyProceduralStatsSharedPtr _stats;
+    bool _statsEnabled = false; // primvars:stats as of the last Update
+    std::map<SdfPath, _Source> _sources;
+    std::map<SdfPath, _Shard> _shards; // every source's shards by child path
 };
 
-PXR_NAMESPACE_CLOSE_SCOPE
\ No newline at end of file
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,225 @@
+#include "gp_furBakeCache.h"
+
+#include "pxr/base/arch/fileSystem.h"
+#include "pxr/base/arch/hash.h"
+#include "pxr/base/tf/atomicOfstreamWrapper.h"
+#include "pxr/base/tf/diagnostic.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/tf/fileUtils.h"
+#include "pxr/base/tf/stringUtils.h"
+#include "pxr/base/trace/trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_ENV_SETTING(MYGP_FUR_BAKE_CACHE_DIR, "", "Directory of the fur bake cache; empty disables it");
+TF_DEFINE_ENV_SETTING(MYGP_FUR_BAKE_CACHE_MAX_MB, 4096, "Size the fur bake cache directory is kept under, in MiB");
+
+namespace {
+// Bumped whenever the layout, the stencils or the file format change what an entry means.
+constexpr char fileMagic[8] = { 'M', 'Y', 'G', 'P', 'F', 'U', 'R', '1' };
+
+struct FileHeader
+{
+    char magic[8];
+    uint64_t key[2];
+    uint64_t numPoints;
+};
+
+// Keeps a file mapping alive for as long as an array points into it.
+struct MappedPoints : public Vt_ArrayForeignDataSource
+{
+    explicit MappedPoints(ArchConstFileMapping&& m)
+        : Vt_ArrayForeignDataSource(&_Detached)
+        , mapping(std::move(m))
+    {
+    }
+    static void _Detached(Vt_ArrayForeignDataSource* self) { delete static_cast<MappedPoints*>(self); }
+
+    ArchConstFileMapping mapping;
+};
+
+// Bake cache entries in directory as (modification time, size, path). Reads refresh the
+// modification time, so it is the time an entry was last used.
+std::vector<std::tuple<double, uint64_t, std::string>>
+listEntries(std::string const& directory)
+{
+    std::vector<std::string> files;
+    TfReadDir(directory, nullptr, &files, nullptr);
+    std::vector<std::tuple<double, uint64_t, std::string>> entries;
+    for (std::string const& file : files)
+    {
+        if (!TfStringEndsWith(file, ".fur"))
+        {
+            continue;
+        }
+        std::string path = TfStringCatPaths(directory, file);
+        int64_t length   = ArchGetFileLength(path.c_str());
+        double time      = 0.0;
+        if (length >= 0 && ArchGetModificationTime(path.c_str(), &time))
+        {
+            entries.emplace_back(time, uint64_t(length), path);
+        }
+    }
+    return entries;
+}
+} // namespace
+
+MyFurBakeCache::KeyBuilder&
+MyFurBakeCache::KeyBuilder::Append(void const* data, size_t size)
+{
+    // Two independently seeded lanes make accidental collisions a non-issue.
+    char const* bytes = static_cast<char const*>(data);
+    _key.hash[0]      = ArchHash64(bytes, size, _key.hash[0]);
+    _key.hash[1]      = ArchHash64(bytes, size, _key.hash[1] ^ 0x9e3779b97f4a7c15ull);
+    return *this;
+}
+
+MyFurBakeCache const*
+MyFurBakeCache::GetInstance()
+{
+    static std::unique_ptr<MyFurBakeCache> instance = []() {
+        std::string directory = TfGetEnvSetting(MYGP_FUR_BAKE_CACHE_DIR);
+        if (directory.empty())
+        {
+            return std::unique_ptr<MyFurBakeCache>();
+        }
+        if (!TfIsDir(directory) && !TfMakeDirs(directory, -1, true))
+        {
+            TF_WARN("Cannot create fur bake cache directory '%s'", directory.c_str());
+            return std::unique_ptr<MyFurBakeCache>();
+        }
+        uint64_t maxBytes = uint64_t(std::max(1, TfGetEnvSetting(MYGP_FUR_BAKE_CACHE_MAX_MB))) << 20;
+        return std::unique_ptr<MyFurBakeCache>(new MyFurBakeCache(directory, maxBytes));
+    }();
+    return instance.get();
+}
+
+MyFurBakeCache::MyFurBakeCache(std::string const& directory, uint64_t maxBytes)
+    : _directory(directory)
+    , _maxBytes(maxBytes)
+{
+    _Evict();
+}
+
+std::string
+MyFurBakeCache::_GetPath(Key const& key) const
+{
+    return TfStringCatPaths(_directory,
+                            TfStringPrintf("%016llx%016llx.fur",
+                                           (unsigned long long)key.hash[0],
+                                           (unsigned long long)key.hash[1]));
+}
+
+bool
+MyFurBakeCache::Read(Key const& key, VtVec3fArray* points) const
+{
+    TRACE_FUNCTION();
+    std::string path             = _GetPath(key);
+    ArchConstFileMapping mapping = ArchMapFileReadOnly(path);
+    if (!mapping)
+    {
+        return false;
+    }
+    size_t length = ArchGetFileMappingLength(mapping);
+    FileHeader header;
+    if (length < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, mapping.get(), sizeof(header));
+    if (std::memcmp(header.magic, fileMagic, sizeof(fileMagic)) != 0 || header.key[0] != key.hash[0] ||
+        header.key[1] != key.hash[1] || length != sizeof(header) + header.numPoints * sizeof(GfVec3f))
+    {
+        return false;
+    }
+    // Mappings do not update the modification time that eviction goes by, so a hit does,
+    // keeping the frames in use from being evicted first.
+    TfTouchFile(path, false);
+    if (header.numPoints == 0)
+    {
+        *points = VtVec3fArray();
+        return true;
+    }
+
+    // The data follows the header, which keeps it float aligned in the page-aligned mapping.
+    GfVec3f* data       = reinterpret_cast<GfVec3f*>(const_cast<char*>(mapping.get()) + sizeof(header));
+    MappedPoints* owner = new MappedPoints(std::move(mapping));
+    *points             = VtVec3fArray(owner, data, size_t(header.numPoints));
+    return true;
+}
+
+size_t
+MyFurBakeCache::Write(Key const& key, GfVec3f const* points, size_t size) const
+{
+    TRACE_FUNCTION();
+    FileHeader header;
+    std::memcpy(header.magic, fileMagic, sizeof(fileMagic));
+    header.key[0]    = key.hash[0];
+    header.key[1]    = key.hash[1];
+    header.numPoints = size;
+
+    std::string path = _GetPath(key);
+    std::string error;
+    TfAtomicOfstreamWrapper file(path);
+    if (!file.Open(&error))
+    {
+        TF_WARN("Cannot write fur bake cache entry '%s': %s", path.c_str(), error.c_str());
+        return 0;
+    }
+    file.GetStream().write(reinterpret_cast<char const*>(&header), sizeof(header));
+    file.GetStream().write(reinterpret_cast<char const*>(points), std::streamsize(size * sizeof(GfVec3f)));
+    // An unfinished file is discarded with the wrapper; racing writers of the same key
+    // produce the same bytes, so whichever rename lands last is fine.
+    if (!file.GetStream() || !file.Commit(&error))
+    {
+        return 0;
+    }
+    size_t bytes = sizeof(header) + size * sizeof(GfVec3f);
+    if ((_bytes += bytes) > _maxBytes)
+    {
+        _Evict();
+    }
+    return bytes;
+}
+
+void
+MyFurBakeCache::_Evict() const
+{
+    TRACE_FUNCTION();
+    // One scan at a time; writers that also went over the cap find it done.
+    std::unique_lock<std::mutex> lock(_evictMutex, std::try_to_lock);
+    if (!lock)
+    {
+        return;
+    }
+    std::vector<std::tuple<double, uint64_t, std::string>> entries = listEntries(_directory);
+    uint64_t bytes                                                 = 0;
+    for (auto const& entry : entries)
+    {
+        bytes += std::get<1>(entry);
+    }
+    // Down to three quarters, so that a full cache does not rescan on every write.
+    if (bytes > _maxBytes)
+    {
+        std::sort(entries.begin(), entries.end());
+        for (auto const& entry : entries)
+        {
+            if (bytes <= _maxBytes / 4 * 3)
+            {
+                break;
+            }
+            // Another session may have deleted it already, which frees the space just the same.
+            ArchUnlinkFile(std::get<2>(entry).c_str());
+            bytes -= std::get<1>(entry);
+        }
+    }
+    _bytes = bytes;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/pxr.h>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Optional on-disk cache of evaluated fur, enabled by pointing MYGP_FUR_BAKE_CACHE_DIR at a
+// directory. An entry holds the (root, tip) pairs of one shard at one time sample and is
+// named after a 128-bit key over everything that decides them. Entries are written to a
+// temporary file and renamed into place, so concurrent sessions sharing a local directory
+// only ever see complete files. Reads map the file and hand the mapping to VtArray as is.
+// The directory is kept under MYGP_FUR_BAKE_CACHE_MAX_MB by deleting the least recently
+// used entries: a hit refreshes the modification time of its file.
+class MyFurBakeCache
+{
+public:
+    struct Key
+    {
+        uint64_t hash[2] = { 0, 0 };
+
+        bool operator==(Key const& other) const { return hash[0] == other.hash[0] && hash[1] == other.hash[1]; }
+    };
+
+    // Hashes the inputs of an entry in order.
+    class KeyBuilder
+    {
+    public:
+        KeyBuilder& Append(void const* data, size_t size);
+        template <typename T>
+        KeyBuilder& Append(T const& value)
+        {
+            return Append(&value, sizeof(value));
+        }
+        Key const& Get() const { return _key; }
+
+    private:
+        Key _key;
+    };
+
+    // Null unless MYGP_FUR_BAKE_CACHE_DIR is set.
+    static MyFurBakeCache const* GetInstance();
+
+    bool Read(Key const& key, VtVec3fArray* points) const;
+    // Returns the number of bytes written, 0 when the entry could not be written.
+    size_t Write(Key const& key, GfVec3f const* points, size_t size) const;
+
+private:
+    MyFurBakeCache(std::string const& directory, uint64_t maxBytes);
+    std::string _GetPath(Key const& key) const;
+    // Rescans the directory and deletes the least recently used entries until it is well
+    // under the cap.
+    void _Evict() const;
+
+    std::string _directory;
+    uint64_t _maxBytes;
+    // Size of the directory as of the last scan plus what this process wrote since. Other
+    // sessions sharing the directory are only seen by the next scan.
+    mutable std::atomic<uint64_t> _bytes{ 0 };
+    mutable std::mutex _evictMutex;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
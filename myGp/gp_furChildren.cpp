@@ -0,0 +1,174 @@
+#include "gp_furChildren.h"
+#include "gp_random.h"
+
+#include "pxr/base/gf/range3f.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
+
+#include <algorithm>
+#include <cmath>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+// Children draw from streams disjoint from the per-face root streams.
+constexpr uint32_t childStreamBase = 0x80000000u;
+
+constexpr int maxNeighbours = 6;
+
+// Uniform grid over the guide roots, sized for a few guides per cell.
+class GuideGrid
+{
+public:
+    GuideGrid(GfVec3f const* roots, int numRoots)
+        : _roots(roots)
+    {
+        GfRange3f bounds;
+        for (int i = 0; i < numRoots; ++i)
+        {
+            bounds.UnionWith(roots[i]);
+        }
+        // Roots lie on a surface, so spacing grows with the square root of the count.
+        GfVec3f size = bounds.GetSize();
+        float extent = std::max({ size[0], size[1], size[2], 1e-6f });
+        _cellSize    = 2.0f * extent / std::max(1.0f, std::sqrt(float(numRoots)));
+        _origin      = bounds.GetMin();
+        _cells.resize(numRoots);
+        for (int i = 0; i < numRoots; ++i)
+        {
+            _cells[i] = { _Key(_Cell(roots[i])), i };
+        }
+        std::sort(_cells.begin(), _cells.end());
+    }
+
+    // Up to maxNeighbours nearest roots to root i (excluding i), closest first.
+    int FindNeighbours(int i, int* neighbours) const
+    {
+        std::pair<float, int> nearest[maxNeighbours];
+        int count    = 0;
+        GfVec3i cell = _Cell(_roots[i]);
+        for (int dz = -1; dz <= 1; ++dz)
+        {
+            for (int dy = -1; dy <= 1; ++dy)
+            {
+                for (int dx = -1; dx <= 1; ++dx)
+                {
+                    uint64_t key = _Key(cell + GfVec3i(dx, dy, dz));
+                    auto it      = std::lower_bound(_cells.begin(), _cells.end(), std::make_pair(key, 0));
+                    for (; it != _cells.end() && it->first == key; ++it)
+                    {
+                        if (it->second == i)
+                        {
+                            continue;
+                        }
+                        float d = (_roots[it->second] - _roots[i]).GetLengthSq();
+                        if (count < maxNeighbours)
+                        {
+                            nearest[count++] = { d, it->second };
+                        }
+                        else if (d < nearest[maxNeighbours - 1].first)
+                        {
+                            nearest[maxNeighbours - 1] = { d, it->second };
+                        }
+                        else
+                        {
+                            continue;
+                        }
+                        std::sort(nearest, nearest + count);
+                    }
+                }
+            }
+        }
+        for (int n = 0; n < count; ++n)
+        {
+            neighbours[n] = nearest[n].second;
+        }
+        return count;
+    }
+
+private:
+    GfVec3i _Cell(GfVec3f const& p) const
+    {
+        GfVec3f c = (p - _origin) / _cellSize;
+        return GfVec3i(int(std::floor(c[0])), int(std::floor(c[1])), int(std::floor(c[2])));
+    }
+    static uint64_t _Key(GfVec3i const& c)
+    {
+        return (uint64_t(uint32_t(c[0]) & 0x1fffff) << 42) | (uint64_t(uint32_t(c[1]) & 0x1fffff) << 21) |
+               uint64_t(uint32_t(c[2]) & 0x1fffff);
+    }
+
+    GfVec3f const* _roots;
+    GfVec3f _origin;
+    float _cellSize;
+    std::vector<std::pair<uint64_t, int>> _cells;
+};
+} // namespace
+
+std::unique_ptr<MyFurChildren const>
+MyFurChildren::Create(GfVec3f const* guideRoots, int numGuides, int childrenPerGuide)
+{
+    TRACE_FUNCTION();
+    std::unique_ptr<MyFurChildren> children(new MyFurChildren);
+    if (numGuides <= 0 || childrenPerGuide <= 0)
+    {
+        return children;
+    }
+
+    size_t numChildren = size_t(numGuides) * childrenPerGuide;
+    children->_indices.resize(3 * numChildren);
+    children->_weights.resize(3 * numChildren);
+
+    GuideGrid grid(guideRoots, numGuides);
+    WorkParallelForN(numGuides, [&](size_t begin, size_t end) {
+        int neighbours[maxNeighbours];
+        for (int guide = int(begin); guide < int(end); ++guide)
+        {
+            int numNeighbours = grid.FindNeighbours(guide, neighbours);
+            MyRandomStream random(childStreamBase | uint32_t(guide));
+            for (int c = 0; c < childrenPerGuide; ++c)
+            {
+                size_t child = size_t(guide) * childrenPerGuide + c;
+                int* indices = &children->_indices[3 * child];
+                float* w     = &children->_weights[3 * child];
+
+                // A random triangle of the fan around the parent, sampled uniformly.
+                int a      = numNeighbours > 0 ? neighbours[int(random.Next() * numNeighbours)] : guide;
+                int b      = numNeighbours > 1 ? neighbours[int(random.Next() * numNeighbours)] : a;
+                float r1   = std::sqrt(random.Next());
+                float r2   = random.Next();
+                indices[0] = guide;
+                indices[1] = a;
+                indices[2] = b;
+                w[0]       = 1.0f - r1;
+                w[1]       = r1 * (1.0f - r2);
+                w[2]       = r1 * r2;
+            }
+        }
+    });
+    return children;
+}
+
+size_t
+MyFurChildren::GetMemoryUsage() const
+{
+    return _indices.capacity() * sizeof(int) + _weights.capacity() * sizeof(float);
+}
+
+void
+MyFurChildren::Evaluate(GfVec3f const* guides, float clump, size_t begin, size_t end, GfVec3f* out) const
+{
+    int const* indices = _indices.data();
+    float const* w     = _weights.data();
+    for (size_t child = begin; child < end; ++child)
+    {
+        int const* n    = indices + 3 * child;
+        float const* cw = w + 3 * child;
+        GfVec3f root    = cw[0] * guides[2 * n[0]] + cw[1] * guides[2 * n[1]] + cw[2] * guides[2 * n[2]];
+        GfVec3f tip     = cw[0] * guides[2 * n[0] + 1] + cw[1] * guides[2 * n[1] + 1] + cw[2] * guides[2 * n[2] + 1];
+        out[2 * (child - begin)]     = root;
+        out[2 * (child - begin) + 1] = tip + clump * (guides[2 * n[0] + 1] - tip);
+    }
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/pxr.h>
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Child hairs interpolated from guide hairs. Every child blends three guides, its parent and
+// two of the parent's nearest neighbours, with fixed barycentric weights. The neighbour table
+// is built once from the guide roots, so a frame is a gather-and-blend over the evaluated guides.
+class MyFurChildren
+{
+public:
+    // Builds childrenPerGuide children around each of the numGuides roots.
+    static std::unique_ptr<MyFurChildren const> Create(GfVec3f const* guideRoots,
+                                                       int numGuides,
+                                                       int childrenPerGuide);
+
+    size_t GetNumChildren() const { return _weights.size() / 3; }
+    size_t GetMemoryUsage() const;
+
+    // The three guides a child blends, its parent first.
+    int const* GetGuides(size_t child) const { return &_indices[3 * child]; }
+
+    // Writes (root, tip) pairs of children [begin, end) into out, starting at out[0].
+    // guides holds the (root, tip) pairs of the guides. clump in [0, 1] pulls the child
+    // tips towards the tip of their parent guide.
+    void Evaluate(GfVec3f const* guides, float clump, size_t begin, size_t end, GfVec3f* out) const;
+
+private:
+    MyFurChildren() = default;
+
+    std::vector<int> _indices;    // [child][3], the parent guide first
+    std::vector<float> _weights;  // [child][3]
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,236 @@
+#include "gp_furCulling.h"
+#include "gp_random.h"
+
+#include "pxr/base/gf/range3d.h"
+#include "pxr/base/gf/vec4d.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+namespace {
+// Thinning draws from streams disjoint from the root (ptex face) and child streams.
+constexpr uint32_t cullingStreamBase = 0x40000000u;
+
+inline int
+ptexFacesOf(int nverts)
+{
+    return nverts == 4 ? 1 : nverts;
+}
+
+// Bit set for each clip plane the point is outside of.
+inline unsigned
+outcode(GfVec4d const& p)
+{
+    return (p[0] < -p[3] ? 1u : 0u) | (p[0] > p[3] ? 2u : 0u) | (p[1] < -p[3] ? 4u : 0u) | (p[1] > p[3] ? 8u : 0u) |
+           (p[2] < -p[3] ? 16u : 0u) | (p[2] > p[3] ? 32u : 0u);
+}
+} // namespace
+
+std::shared_ptr<MyFurCulling const>
+MyFurCulling::Create(MyTopology const& topology)
+{
+    TRACE_FUNCTION();
+    std::shared_ptr<MyFurCulling> culling(new MyFurCulling());
+    culling->_faceVertexCounts  = topology.faceVertexCounts;
+    culling->_faceVertexIndices = topology.faceVertexIndices;
+
+    VtIntArray const& faceVertexCounts = topology.faceVertexCounts;
+    VtIntArray const& faceIndices      = topology.faceVertexIndices;
+    size_t numFaces                    = faceVertexCounts.size();
+    size_t numVertices                 = size_t(std::max(0, topology.numVertices));
+
+    std::vector<int>& faceOffsets = culling->_faceOffsets;
+    faceOffsets.resize(numFaces + 1, 0);
+    for (size_t face = 0; face < numFaces; ++face)
+    {
+        faceOffsets[face + 1] = faceOffsets[face] + std::max(0, faceVertexCounts[face]);
+    }
+    // Unrefined topologies never went through OpenSubdiv's checks.
+    auto inRange = [&](int v) { return v >= 0 && size_t(v) < numVertices; };
+    if (size_t(faceOffsets.back()) != faceIndices.size() ||
+        !std::all_of(faceIndices.begin(), faceIndices.end(), inRange))
+    {
+        return nullptr;
+    }
+
+    // Faces around every vertex, as a CSR table.
+    std::vector<int> vertexFaceOffsets(numVertices + 1, 0), vertexFaces(faceIndices.size());
+    for (int v : faceIndices)
+    {
+        ++vertexFaceOffsets[v + 1];
+    }
+    std::partial_sum(vertexFaceOffsets.begin(), vertexFaceOffsets.end(), vertexFaceOffsets.begin());
+    std::vector<int> fill(vertexFaceOffsets.begin(), vertexFaceOffsets.end() - 1);
+    for (size_t face = 0; face < numFaces; ++face)
+    {
+        for (int i = faceOffsets[face]; i < faceOffsets[face + 1]; ++i)
+        {
+            vertexFaces[fill[faceIndices[i]]++] = int(face);
+        }
+    }
+
+    // One-ring of every face, gathered in parallel and then packed.
+    std::vector<std::vector<int>> rings(numFaces);
+    WorkParallelForN(numFaces, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face)
+        {
+            std::vector<int>& ring = rings[face];
+            for (int i = faceOffsets[face]; i < faceOffsets[face + 1]; ++i)
+            {
+                int v = faceIndices[i];
+                for (int j = vertexFaceOffsets[v]; j < vertexFaceOffsets[v + 1]; ++j)
+                {
+                    int other = vertexFaces[j];
+                    ring.insert(ring.end(),
+                                faceIndices.cdata() + faceOffsets[other],
+                                faceIndices.cdata() + faceOffsets[other + 1]);
+                }
+            }
+            std::sort(ring.begin(), ring.end());
+            ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+        }
+    });
+    culling->_supportOffsets.resize(numFaces + 1, 0);
+    for (size_t face = 0; face < numFaces; ++face)
+    {
+        culling->_supportOffsets[face + 1] = culling->_supportOffsets[face] + int(rings[face].size());
+    }
+    culling->_support.reserve(culling->_supportOffsets.back());
+    for (std::vector<int> const& ring : rings)
+    {
+        culling->_support.insert(culling->_support.end(), ring.begin(), ring.end());
+    }
+    return culling;
+}
+
+void
+MyFurCulling::ComputeVisibleGuides(MyFurLayout const& layout,
+                                   GfVec3f const* points,
+                                   float length,
+                                   MyFurCullingParams const& params,
+                                   std::vector<int>* guides) const
+{
+    TRACE_FUNCTION();
+    size_t numFaces = _faceVertexCounts.size();
+    std::vector<float> fractions(numFaces);
+    WorkParallelForN(numFaces, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face)
+        {
+            fractions[face] = _ComputeFraction(face, points, length, params);
+        }
+    });
+
+    std::vector<int> const& faceOffsets = layout.GetFaceOffsets();
+    guides->clear();
+    uint32_t ptexFace = 0;
+    for (size_t face = 0; face < numFaces; ++face)
+    {
+        float fraction = fractions[face];
+        for (int k = 0; k < ptexFacesOf(_faceVertexCounts[face]); ++k, ++ptexFace)
+        {
+            int first = faceOffsets[ptexFace];
+            int last  = faceOffsets[ptexFace + 1];
+            if (fraction >= 1.0f)
+            {
+                for (int guide = first; guide < last; ++guide)
+                {
+                    guides->push_back(guide);
+                }
+            }
+            else if (fraction > 0.0f)
+            {
+                MyRandomStream random(cullingStreamBase + ptexFace);
+                for (int guide = first; guide < last; ++guide)
+                {
+                    if (random.Next() < fraction)
+                    {
+                        guides->push_back(guide);
+                    }
+                }
+            }
+        }
+    }
+}
+
+float
+MyFurCulling::_ComputeFraction(size_t face, GfVec3f const* points, float length, MyFurCullingParams const& params) const
+{
+    double grow = std::abs(double(length)) + std::max(0.0, double(params.margin));
+
+    GfRange3d bounds;
+    for (int i = _supportOffsets[face]; i < _supportOffsets[face + 1]; ++i)
+    {
+        bounds.UnionWith(GfVec3d(points[_support[i]]));
+    }
+    if (bounds.IsEmpty())
+    {
+        return 1.0f;
+    }
+    GfVec3d lo = bounds.GetMin() - GfVec3d(grow);
+    GfVec3d hi = bounds.GetMax() + GfVec3d(grow);
+
+    // Outside the frustum when all corners are outside of the same clip plane.
+    unsigned common = 0x3fu;
+    for (int corner = 0; corner < 8 && common; ++corner)
+    {
+        GfVec4d p((corner & 1) ? hi[0] : lo[0], (corner & 2) ? hi[1] : lo[1], (corner & 4) ? hi[2] : lo[2], 1.0);
+        common &= outcode(p * params.viewProjection);
+    }
+    if (common)
+    {
+        return 0.0f;
+    }
+
+    // Newell normal and centroid of the face itself, for the right-handed orientation USD
+    // meshes default to.
+    GfVec3d normal(0.0), centroid(0.0);
+    int first = _faceOffsets[face];
+    int n     = _faceOffsets[face + 1] - first;
+    for (int i = 0; i < n; ++i)
+    {
+        GfVec3d a(points[_faceVertexIndices[first + i]]);
+        GfVec3d b(points[_faceVertexIndices[first + (i + 1) % n]]);
+        normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+        normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+        normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+        centroid += a;
+    }
+    centroid /= double(std::max(1, n));
+    double magnitude = normal.Normalize();
+
+    // Hairs on faces just past the silhouette still stick out over it, so a face only goes
+    // once the eye is further behind its plane than the hairs reach.
+    if (params.backfaces && magnitude > 0.0)
+    {
+        if (params.orthographic)
+        {
+            // No eye point: compare the tilt over the extent of the face's support instead.
+            double radius = 0.5 * (bounds.GetMax() - bounds.GetMin()).GetLength();
+            if (GfDot(normal, -params.viewDirection) * radius < -grow)
+            {
+                return 0.0f;
+            }
+        }
+        else if (GfDot(normal, params.position - centroid) < -grow)
+        {
+            return 0.0f;
+        }
+    }
+
+    if (params.falloffDistance > 0.0f && !params.orthographic)
+    {
+        double distance = (centroid - params.position).GetLength();
+        if (distance > params.falloffDistance)
+        {
+            return float(params.falloffDistance / distance);
+        }
+    }
+    return 1.0f;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
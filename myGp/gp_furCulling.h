@@ -0,0 +1,79 @@
+#pragma once
+
+#include "gp_furLayout.h"
+#include "gp_topologyCache.h"
+
+#include <pxr/base/gf/matrix4d.h>
+#include <pxr/base/gf/vec3d.h>
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/pxr.h>
+
+#include <memory>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Culling camera as seen from the fur, i.e. in the space of the source mesh points.
+struct MyFurCullingParams
+{
+    bool enabled = false;
+    GfMatrix4d viewProjection{ 1.0 }; // points to clip space (row vectors, OpenGL clip volume)
+    GfVec3d position;                 // eye
+    GfVec3d viewDirection{ 0.0, 0.0, -1.0 };
+    bool orthographic = false;
+    // Extra room around every face, for hairs that bend or get longer than length.
+    float margin = 0.0f;
+    bool backfaces = true;
+    // When positive, faces further away than this keep a falloffDistance / distance share
+    // of their curves (perspective cameras only).
+    float falloffDistance = 0.0f;
+
+    bool operator==(MyFurCullingParams const& other) const
+    {
+        return enabled == other.enabled && viewProjection == other.viewProjection && position == other.position &&
+               viewDirection == other.viewDirection && orthographic == other.orthographic && margin == other.margin &&
+               backfaces == other.backfaces && falloffDistance == other.falloffDistance;
+    }
+    bool operator!=(MyFurCullingParams const& other) const { return !(*this == other); }
+};
+
+// Per-face visibility of the fur from a culling camera. The limit patch of a face lies in
+// the convex hull of its one-ring of control vertices (the vertices of every face sharing a
+// vertex with it), so the bounds of that one-ring grown by the hair length and the margin
+// contain every curve rooted on the face. Faces outside the frustum are dropped whole,
+// faces turned away from the camera are dropped outside of a band around the silhouette,
+// and distant faces are thinned out by the falloff.
+class MyFurCulling
+{
+public:
+    // Depends only on the mesh arrays of topology, so it serves every quality tier. Returns
+    // null for arrays that do not describe a valid mesh.
+    static std::shared_ptr<MyFurCulling const> Create(MyTopology const& topology);
+
+    bool IsIdentical(VtIntArray const& faceVertexCounts, VtIntArray const& faceVertexIndices) const
+    {
+        return _faceVertexCounts.IsIdentical(faceVertexCounts) && _faceVertexIndices.IsIdentical(faceVertexIndices);
+    }
+
+    // Writes the guides of layout that survive culling, in ascending order. A thinned face
+    // keeps a fixed random subset of its guides for each share, so curves drop out one by
+    // one as the camera moves away instead of all changing at once.
+    void ComputeVisibleGuides(MyFurLayout const& layout,
+                              GfVec3f const* points,
+                              float length,
+                              MyFurCullingParams const& params,
+                              std::vector<int>* guides) const;
+
+private:
+    MyFurCulling() = default;
+
+    float _ComputeFraction(size_t face, GfVec3f const* points, float length, MyFurCullingParams const& params) const;
+
+    VtIntArray _faceVertexCounts, _faceVertexIndices;
+    std::vector<int> _faceOffsets;    // first face-vertex of each face
+    std::vector<int> _supportOffsets; // per face, into _support
+    std::vector<int> _support;        // one-ring vertices of each face
+};
+using MyFurCullingSharedPtr = std::shared_ptr<MyFurCulling const>;
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,1377 @@
+#include "gp_furEvaluator.h"
+#include "gp_debugCodes.h"
+
+#include "pxr/base/arch/hash.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/tf/staticTokens.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
+#include "pxr/base/work/threadLimits.h"
+#include "pxr/base/work/withScopedParallelism.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_ENV_SETTING(MYGP_FUR_INCREMENTAL_PERCENT,
+                      50,
+                      "Largest share of dirty slices, in percent, for which a frame is patched into the previous "
+                      "result instead of evaluated in full; 0 disables patching");
+
+TF_DEFINE_PRIVATE_TOKENS(_qualityTokens,
+                         (preview) //
+                         (medium)  //
+                         (full)    //
+);
+
+namespace {
+template <typename T>
+T
+getValue(HdSampledDataSourceHandle const& ds, HdSampledDataSource::Time shutterOffset, T const& defaultValue)
+{
+    return ds ? ds->GetValue(shutterOffset).GetWithDefault<T>(defaultValue) : defaultValue;
+}
+
+// Counts may be authored as int or float.
+int
+getCount(HdSampledDataSourceHandle const& ds, HdSampledDataSource::Time shutterOffset, int defaultValue)
+{
+    if (!ds)
+    {
+        return defaultValue;
+    }
+    VtValue v = ds->GetValue(shutterOffset);
+    return v.IsHolding<int>() ? v.UncheckedGet<int>() : int(v.GetWithDefault<float>(float(defaultValue)));
+}
+
+// The typed interface hands arrays out without boxing them into a VtValue, which costs a
+// heap allocation for anything as large as a VtArray.
+template <typename T>
+T
+getArray(HdSampledDataSourceHandle const& ds, HdSampledDataSource::Time shutterOffset)
+{
+    if (auto typed = std::dynamic_pointer_cast<HdTypedSampledDataSource<T>>(ds))
+    {
+        return typed->GetTypedValue(shutterOffset);
+    }
+    return getValue<T>(ds, shutterOffset, T());
+}
+
+// Shards split the guides at slice boundaries so each one evaluates whole slices.
+std::pair<int, int>
+shardGuides(int numGuides, int numShards, int shard)
+{
+    constexpr int W   = MyFurStencils::SliceWidth;
+    int64_t numSlices = (int64_t(numGuides) + W - 1) / W;
+    int first         = int(numSlices * shard / numShards) * W;
+    int last          = int(numSlices * (shard + 1) / numShards) * W;
+    return { std::min(first, numGuides), std::min(last, numGuides) };
+}
+
+// Positions in the ascending visible guide list of the guides in [guides.first, guides.second).
+std::pair<size_t, size_t>
+visibleRange(std::vector<int> const& visible, std::pair<int, int> guides)
+{
+    auto first = std::lower_bound(visible.begin(), visible.end(), guides.first);
+    auto last  = std::lower_bound(first, visible.end(), guides.second);
+    return { size_t(first - visible.begin()), size_t(last - visible.begin()) };
+}
+} // namespace
+
+VtVec3fArray
+MyFurInputs::GetPoints(Time shutterOffset) const
+{
+    return getArray<VtVec3fArray>(points, shutterOffset);
+}
+
+VtIntArray
+MyFurInputs::GetFaceVertexCounts(Time shutterOffset) const
+{
+    return getArray<VtIntArray>(faceVertexCounts, shutterOffset);
+}
+
+VtIntArray
+MyFurInputs::GetFaceIndices(Time shutterOffset) const
+{
+    return getArray<VtIntArray>(faceIndices, shutterOffset);
+}
+
+MyFurLayoutParams
+MyFurInputs::GetLayoutParams(Time shutterOffset) const
+{
+    MyFurLayoutParams params;
+    params.numSamplesPerFace = int(getValue<float>(numSamplesPerFace, shutterOffset, 1.0f));
+    params.density           = getArray<VtFloatArray>(density, shutterOffset);
+    params.childrenPerGuide  = getCount(childrenPerGuide, shutterOffset, 0);
+    int budget               = getCount(maxCurves, shutterOffset, 0);
+    if (budget > 0)
+    {
+        params.maxCurves = int(std::floor(budget * budgetEnd) - std::floor(budget * budgetBegin));
+        // A share that rounds down to nothing means no curves, not numSamplesPerFace per face.
+        if (params.maxCurves <= 0)
+        {
+            params.maxCurves         = 0;
+            params.numSamplesPerFace = 0;
+        }
+    }
+    // Only area weights and child neighbours look at the rest pose.
+    if (params.maxCurves > 0 || params.childrenPerGuide > 0)
+    {
+        params.rest = rest;
+    }
+    return params;
+}
+
+float
+MyFurInputs::GetLength(Time shutterOffset) const
+{
+    return getValue<float>(length, shutterOffset, 0.1f);
+}
+
+float
+MyFurInputs::GetClump(Time shutterOffset) const
+{
+    return std::clamp(getValue<float>(clump, shutterOffset, 0.0f), 0.0f, 1.0f);
+}
+
+MyTopologyOptions
+MyFurInputs::GetTopologyOptions(Time shutterOffset) const
+{
+    MyTopologyOptions options;
+    if (!quality)
+    {
+        return options;
+    }
+    // Token or string primvars both work.
+    VtValue value = quality->GetValue(shutterOffset);
+    TfToken tier  = value.IsHolding<TfToken>() ? value.UncheckedGet<TfToken>()
+                                               : TfToken(value.GetWithDefault<std::string>(std::string()));
+    if (tier == _qualityTokens->preview)
+    {
+        options.refine = false;
+    }
+    else if (tier == _qualityTokens->medium)
+    {
+        options.isolationLevel = 2;
+        options.endCap         = OpenSubdiv::Far::PatchTableFactory::Options::ENDCAP_BSPLINE_BASIS;
+    }
+    return options;
+}
+
+int
+MyFurInputs::GetLookAheadFrames() const
+{
+    if (culling.enabled || WorkGetConcurrencyLimit() <= 1)
+    {
+        return 0;
+    }
+    return std::max(0, getCount(lookAheadFrames, 0.0f, 0));
+}
+
+MyFurEvaluator::MyFurEvaluator(MyProceduralStatsSharedPtr const& stats)
+    : _stats(stats)
+    , _state(std::make_shared<_State>())
+    , _pool(stats)
+{
+}
+
+MyFurEvaluator::~MyFurEvaluator()
+{
+    // Stop a look-ahead early; _dispatcher then waits for whatever is still running.
+    ++_lookAheadGeneration;
+}
+
+void
+MyFurEvaluator::SetInputs(MyFurInputs const& inputs, int numShards)
+{
+    // Only Update calls this, so there is a single writer.
+    auto state        = std::make_shared<_State>();
+    state->inputs     = inputs;
+    state->numShards  = std::max(1, numShards);
+    state->generation = _GetState()->generation + 1;
+
+    // In steady state every shard holds, per time sample, the memo's array, the render
+    // delegate's and the retained result, plus its look-ahead frames; the guides add one per
+    // time and one for the look-ahead. Buffers coming back within that stay pooled for the next frame.
+    size_t lookAhead = size_t(std::max(0, inputs.GetLookAheadFrames()));
+    _pool.SetCapacity((3 * MaxTimes + lookAhead) * size_t(state->numShards) + MaxTimes + 1);
+
+    std::atomic_store(&_state, std::shared_ptr<_State const>(std::move(state)));
+}
+
+MyFurInputs
+MyFurEvaluator::GetInputs() const
+{
+    return _GetState()->inputs;
+}
+
+int
+MyFurEvaluator::GetNumShards() const
+{
+    return _GetState()->numShards;
+}
+
+std::pair<int, int>
+MyFurEvaluator::GetShardGuides(int numGuides, int shard) const
+{
+    return shardGuides(numGuides, GetNumShards(), shard);
+}
+
+std::shared_ptr<MyFurEvaluator::_State const>
+MyFurEvaluator::_GetState() const
+{
+    return std::atomic_load(&_state);
+}
+
+int
+MyFurEvaluator::ComputeNumCurves(int shard, Time shutterOffset)
+{
+    std::shared_ptr<_State const> state = _GetState();
+    MyFurInputs const& inputs           = state->inputs;
+    if (!inputs.faceVertexCounts)
+    {
+        return 0;
+    }
+    if (inputs.culling.enabled)
+    {
+        // Same layout and visibility as Evaluate at this time.
+        if (!inputs.faceIndices || !inputs.points)
+        {
+            return 0;
+        }
+        MyFurLayoutSharedPtr layout = _GetLayout(inputs, shutterOffset, inputs.GetPoints(shutterOffset));
+        if (!layout || !layout->GetStencils())
+        {
+            return 0;
+        }
+        std::shared_ptr<_Visibility const> visibility = _GetVisibility(*state, layout);
+        std::pair<int, int> guides                    = shardGuides(layout->GetNumGuides(), state->numShards, shard);
+        std::pair<size_t, size_t> visible             = visibleRange(visibility->guides, guides);
+
+        int childrenPerGuide = layout->GetChildren() ? layout->GetParams().childrenPerGuide : 0;
+        return int(visible.second - visible.first) * (1 + childrenPerGuide);
+    }
+    VtIntArray faceVertexCounts = inputs.GetFaceVertexCounts(shutterOffset);
+    MyFurLayoutParams params    = inputs.GetLayoutParams(shutterOffset);
+    int numGuides               = MyFurLayout::ComputeNumGuides(faceVertexCounts, params);
+    std::pair<int, int> guides  = shardGuides(numGuides, state->numShards, shard);
+    return (guides.second - guides.first) * (1 + std::max(0, params.childrenPerGuide));
+}
+
+void
+MyFurEvaluator::Evaluate(int shard, size_t numTimes, Time const* times, VtVec3fArray* results, bool* evaluated)
+{
+    _Evaluate(shard, numTimes, times, results, evaluated, false);
+}
+
+void
+MyFurEvaluator::_Evaluate(
+    int shard, size_t numTimes, Time const* times, VtVec3fArray* results, bool* evaluated, bool lookAhead)
+{
+    TRACE_FUNCTION();
+    MyScopedEvaluationTimer timer(_stats.get());
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        results[i]   = VtVec3fArray();
+        evaluated[i] = true;
+    }
+    // One snapshot of the inputs for the whole evaluation, however Update moves on meanwhile.
+    std::shared_ptr<_State const> state = _GetState();
+    MyFurInputs const& inputs           = state->inputs;
+    if (!inputs.faceVertexCounts || !inputs.faceIndices || !inputs.points || numTimes == 0)
+    {
+        return;
+    }
+
+    // Per-sample scratch lives on the stack for up to MaxTimes samples.
+    TfSmallVector<VtVec3fArray, MaxTimes> points(numTimes);
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        points[i] = inputs.GetPoints(times[i]);
+    }
+
+    // Baked or looked-ahead samples skip everything below, including the refiner and layout
+    // builds.
+    MyFurBakeCache const* bakeCache = MyFurBakeCache::GetInstance();
+    int lookAheadFrames             = inputs.GetLookAheadFrames();
+    TfSmallVector<MyFurBakeCache::Key, MaxTimes> keys;
+    TfSmallVector<bool, MaxTimes> baked(numTimes, false);
+    if (bakeCache || lookAheadFrames > 0)
+    {
+        keys.resize(numTimes);
+        _GetBakeKeys(inputs, state->numShards, shard, numTimes, times, points.data(), keys.data());
+        size_t numBaked = 0;
+        for (size_t i = 0; i < numTimes; ++i)
+        {
+            baked[i] = (lookAheadFrames > 0 && _FindLookAhead(keys[i], &results[i])) ||
+                       (bakeCache && bakeCache->Read(keys[i], &results[i]));
+            numBaked += baked[i] ? 1 : 0;
+        }
+        if (numBaked == numTimes)
+        {
+            return;
+        }
+    }
+
+    MyFurLayoutSharedPtr layout   = _GetLayout(inputs, times[0], points[0]);
+    MyFurStencils const* stencils = layout ? layout->GetStencils() : nullptr;
+    if (!stencils)
+    {
+        return;
+    }
+
+    // Samples evaluated together against this layout.
+    TfSmallVector<size_t, MaxTimes> slots;
+    TfSmallVector<Time, MaxTimes> slotTimes;
+    TfSmallVector<GfVec3f const*, MaxTimes> in;
+    TfSmallVector<float, MaxTimes> lengths, clumps;
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        if (baked[i])
+        {
+            continue;
+        }
+        if (int(points[i].size()) != layout->GetTopology()->numVertices)
+        {
+            evaluated[i] = false;
+            continue;
+        }
+        slots.push_back(i);
+        slotTimes.push_back(times[i]);
+        in.push_back(points[i].cdata());
+        lengths.push_back(inputs.GetLength(times[i]));
+        clumps.push_back(inputs.GetClump(times[i]));
+    }
+
+    MyFurChildren const* children = layout->GetChildren();
+    int childrenPerGuide          = children ? layout->GetParams().childrenPerGuide : 0;
+    std::pair<int, int> guides    = shardGuides(layout->GetNumGuides(), state->numShards, shard);
+    size_t numGuides              = size_t(guides.second - guides.first);
+    // With a culling camera only the visible guides of the shard are written, followed by
+    // their children as usual.
+    bool culled        = inputs.culling.enabled;
+    int const* visible = nullptr;
+    std::shared_ptr<_Visibility const> visibility;
+    if (culled)
+    {
+        visibility                      = _GetVisibility(*state, layout);
+        std::pair<size_t, size_t> range = visibleRange(visibility->guides, guides);
+        visible                         = visibility->guides.data() + range.first;
+        numGuides                       = range.second - range.first;
+    }
+    size_t numCurves = numGuides * (1 + childrenPerGuide);
+    // Culling decides its curves from scratch, so only unculled single samples are retained.
+    bool retain = slots.size() == 1 && !culled && !lookAhead;
+    // Every sample is written straight into its final, pooled array.
+    TfSmallVector<GfVec3f*, MaxTimes> out(slots.size());
+    for (size_t j = 0; j < slots.size(); ++j)
+    {
+        results[slots[j]] = _pool.Allocate(2 * numCurves, &out[j]);
+    }
+    if (_stats)
+    {
+        _stats->AddCurvesEmitted(slots.size() * numCurves);
+    }
+
+    bool patched = retain && _EvaluateIncremental(layout,
+                                                  *state,
+                                                  shard,
+                                                  slotTimes[0],
+                                                  points[slots[0]],
+                                                  lengths[0],
+                                                  clumps[0],
+                                                  numCurves,
+                                                  out[0]);
+    if (patched)
+    {
+        // out already holds the previous result with the moved parts evaluated again.
+    }
+    else if (!children && culled)
+    {
+        // Slices without a visible guide are skipped. The others are evaluated into a buffer
+        // on the stack, from which their visible guides are copied out.
+        constexpr int W = MyFurStencils::SliceWidth;
+        std::vector<size_t> sliceStarts; // first visible guide of every slice that has one
+        for (size_t i = 0; i < numGuides; ++i)
+        {
+            if (i == 0 || visible[i] / W != visible[i - 1] / W)
+            {
+                sliceStarts.push_back(i);
+            }
+        }
+        sliceStarts.push_back(numGuides);
+        TRACE_SCOPE("Evaluate visible guides");
+        WorkParallelForN(sliceStarts.size() - 1, [&](size_t begin, size_t end) {
+            GfVec3f buffer[MaxTimes][2 * W];
+            GfVec3f* scratch[MaxTimes];
+            for (size_t j = 0; j < slots.size(); ++j)
+            {
+                scratch[j] = buffer[j];
+            }
+            for (size_t k = begin; k < end; ++k)
+            {
+                size_t slice = size_t(visible[sliceStarts[k]]) / W;
+                stencils->EvaluateCurves(
+                    slots.size(), in.data(), lengths.data(), slice, slice + 1, scratch, int(slice) * W);
+                for (size_t j = 0; j < slots.size(); ++j)
+                {
+                    for (size_t i = sliceStarts[k]; i < sliceStarts[k + 1]; ++i)
+                    {
+                        size_t lane       = size_t(visible[i]) - slice * W;
+                        out[j][2 * i]     = buffer[j][2 * lane];
+                        out[j][2 * i + 1] = buffer[j][2 * lane + 1];
+                    }
+                }
+            }
+        });
+    }
+    else if (!children)
+    {
+        // The stencils are factorized down to the control vertices, so a deforming frame
+        // is a single sparse product with the incoming points.
+        constexpr int W   = MyFurStencils::SliceWidth;
+        size_t sliceBegin = size_t(guides.first) / W;
+        size_t sliceEnd   = (size_t(guides.second) + W - 1) / W;
+        TRACE_SCOPE("Evaluate guides");
+        WorkParallelForN(sliceEnd - sliceBegin, [&](size_t begin, size_t end) {
+            stencils->EvaluateCurves(
+                slots.size(), in.data(), lengths.data(), sliceBegin + begin, sliceBegin + end, out.data(), guides.first);
+        });
+    }
+    else
+    {
+        // Children blend guides from anywhere on the mesh, so all guides are evaluated once
+        // and shared by the shards.
+        TfSmallVector<VtVec3fArray, MaxTimes> allGuides(slots.size());
+        _GetGuides(layout,
+                   state->generation,
+                   slots.size(),
+                   slotTimes.data(),
+                   in.data(),
+                   lengths.data(),
+                   lookAhead,
+                   allGuides.data());
+        if (culled)
+        {
+            TRACE_SCOPE("Evaluate visible children");
+            WorkParallelForN(numGuides, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    size_t firstChild = size_t(visible[i]) * childrenPerGuide;
+                    for (size_t j = 0; j < slots.size(); ++j)
+                    {
+                        children->Evaluate(allGuides[j].cdata(),
+                                           clumps[j],
+                                           firstChild,
+                                           firstChild + childrenPerGuide,
+                                           out[j] + 2 * (numGuides + i * childrenPerGuide));
+                    }
+                }
+            });
+            for (size_t j = 0; j < slots.size(); ++j)
+            {
+                for (size_t i = 0; i < numGuides; ++i)
+                {
+                    GfVec3f const* guide = allGuides[j].cdata() + 2 * size_t(visible[i]);
+                    out[j][2 * i]        = guide[0];
+                    out[j][2 * i + 1]    = guide[1];
+                }
+            }
+        }
+        else
+        {
+            size_t firstChild = size_t(guides.first) * childrenPerGuide;
+            TRACE_SCOPE("Evaluate children");
+            WorkParallelForN(numGuides * childrenPerGuide, [&](size_t begin, size_t end) {
+                for (size_t j = 0; j < slots.size(); ++j)
+                {
+                    children->Evaluate(allGuides[j].cdata(),
+                                       clumps[j],
+                                       firstChild + begin,
+                                       firstChild + end,
+                                       out[j] + 2 * (numGuides + begin));
+                }
+            });
+            for (size_t j = 0; j < slots.size(); ++j)
+            {
+                std::copy(allGuides[j].cdata() + 2 * size_t(guides.first),
+                          allGuides[j].cdata() + 2 * size_t(guides.second),
+                          out[j]);
+            }
+        }
+    }
+
+    if (retain)
+    {
+        _Retain(state->numShards,
+                shard,
+                slotTimes[0],
+                layout,
+                points[slots[0]],
+                lengths[0],
+                clumps[0],
+                results[slots[0]]);
+    }
+
+    // A preview standing in for a pending build must not be kept as the requested quality.
+    if (!keys.empty() && layout->GetTopology()->options == inputs.GetTopologyOptions(times[0]))
+    {
+        size_t capacity = size_t(lookAheadFrames + 1) * size_t(state->numShards) * 2;
+        for (size_t j = 0; j < slots.size(); ++j)
+        {
+            if (bakeCache)
+            {
+                // Off the sync path; the array keeps its buffer alive until the file is written.
+                // Single-threaded, nothing would run the task before the evaluator is destroyed.
+                MyFurBakeCache::Key key          = keys[slots[j]];
+                VtVec3fArray result              = results[slots[j]];
+                MyProceduralStatsSharedPtr stats = _stats;
+                auto write                       = [bakeCache, key, result, stats]() {
+                    size_t bytes = bakeCache->Write(key, result.cdata(), result.size());
+                    if (stats)
+                    {
+                        stats->AddBytesBaked(bytes);
+                    }
+                };
+                if (WorkGetConcurrencyLimit() > 1)
+                {
+                    _dispatcher.Run(write);
+                }
+                else
+                {
+                    write();
+                }
+            }
+            if (lookAheadFrames > 0)
+            {
+                _StoreLookAhead(keys[slots[j]], results[slots[j]], capacity);
+            }
+        }
+    }
+}
+
+bool
+MyFurEvaluator::FindMovedShards(VtVec3fArray const& before, VtVec3fArray const& after, std::vector<bool>* moved)
+{
+    TRACE_FUNCTION();
+    int numShards = GetNumShards();
+    std::lock_guard<std::mutex> lock(_mutex);
+    MyFurStencils const* stencils = _layout ? _layout->GetStencils() : nullptr;
+    if (!stencils || before.size() != after.size() || int(after.size()) != _layout->GetTopology()->numVertices)
+    {
+        return false;
+    }
+    moved->assign(numShards, false);
+    if (before.IsIdentical(after))
+    {
+        return true;
+    }
+
+    _shardMoved.assign(numShards, 0);
+    // Parallel loops under the lock are isolated, so this thread never picks up a task that
+    // would wait on the same lock.
+    WorkWithScopedParallelism([&]() {
+        MyFurChildren const* children = _layout->GetChildren();
+        int childrenPerGuide          = children ? _layout->GetParams().childrenPerGuide : 0;
+        int numGuides                 = _layout->GetNumGuides();
+        if (_influenceLayout != _layout || _influence.size() != size_t(numShards))
+        {
+            _influenceLayout = _layout;
+            _influence.assign(numShards, std::vector<int>());
+            WorkParallelForN(numShards, [&](size_t begin, size_t end) {
+                for (size_t shard = begin; shard < end; ++shard)
+                {
+                    std::pair<int, int> guides = shardGuides(numGuides, numShards, int(shard));
+                    std::vector<int> foreign;
+                    for (size_t child = size_t(guides.first) * childrenPerGuide;
+                         child < size_t(guides.second) * childrenPerGuide;
+                         ++child)
+                    {
+                        for (int k = 0; k < 3; ++k)
+                        {
+                            int guide = children->GetGuides(child)[k];
+                            if (guide < guides.first || guide >= guides.second)
+                            {
+                                foreign.push_back(guide);
+                            }
+                        }
+                    }
+                    std::sort(foreign.begin(), foreign.end());
+                    foreign.erase(std::unique(foreign.begin(), foreign.end()), foreign.end());
+
+                    std::vector<int>& cvs = _influence[shard];
+                    for (int guide = guides.first; guide < guides.second; ++guide)
+                    {
+                        stencils->AppendControlVertices(guide, &cvs);
+                    }
+                    for (int guide : foreign)
+                    {
+                        stencils->AppendControlVertices(guide, &cvs);
+                    }
+                    std::sort(cvs.begin(), cvs.end());
+                    cvs.erase(std::unique(cvs.begin(), cvs.end()), cvs.end());
+                }
+            });
+        }
+
+        _changed.resize(after.size());
+        WorkParallelForN(after.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                _changed[i] = before[i] != after[i];
+            }
+        });
+        WorkParallelForN(numShards, [&](size_t begin, size_t end) {
+            for (size_t shard = begin; shard < end; ++shard)
+            {
+                for (int cv : _influence[shard])
+                {
+                    if (_changed[cv])
+                    {
+                        _shardMoved[shard] = 1;
+                        break;
+                    }
+                }
+            }
+        });
+    });
+    for (int shard = 0; shard < numShards; ++shard)
+    {
+        (*moved)[shard] = _shardMoved[shard] != 0;
+    }
+    return true;
+}
+
+void
+MyFurEvaluator::Invalidate()
+{
+    {
+        std::lock_guard<std::mutex> lock(_guidesMutex);
+        _guides.entries.clear();
+        _lookAheadGuides.entries.clear();
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _pointsHashes.clear();
+}
+
+MyFurLayoutSharedPtr
+MyFurEvaluator::_GetLayout(MyFurInputs const& inputs, Time shutterOffset, VtVec3fArray const& points)
+{
+    TRACE_FUNCTION();
+    VtIntArray faceVertexCounts = inputs.GetFaceVertexCounts(shutterOffset);
+    VtIntArray faceIndices      = inputs.GetFaceIndices(shutterOffset);
+    MyFurLayoutParams params    = inputs.GetLayoutParams(shutterOffset);
+    MyTopologyOptions options   = inputs.GetTopologyOptions(shutterOffset);
+    int numVertices             = int(points.size());
+
+    // The layout is kept across deforming frames; only topology or layout parameters move
+    // the roots.
+    auto isCurrent = [&](MyFurLayoutSharedPtr const& layout, MyTopologyOptions const& o) {
+        return layout && layout->GetParams() == params &&
+               layout->GetTopology()->IsIdentical(faceVertexCounts, faceIndices, numVertices, o);
+    };
+    // Layouts are immutable and published whole, so evaluations of a current one never
+    // lock. A rebuild is done by whichever evaluation gets the lock first and then shared.
+    MyFurLayoutSharedPtr layout = std::atomic_load(&_layout);
+    if (isCurrent(layout, options))
+    {
+        return layout;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Refinement and stencil building run parallel loops; see FindMovedShards.
+    WorkWithScopedParallelism([&]() {
+        _AdoptLayoutBuildLocked();
+        if (isCurrent(_layout, options))
+        {
+            return;
+        }
+        // A rest pose that does not match the points (a shutter sample with another vertex
+        // count) is of no use; the roots then follow the points like a plain layout.
+        bool useRest                     = params.rest.size() == points.size();
+        VtVec3fArray const& layoutPoints = useRest ? params.rest : points;
+        if (_async && options.refine)
+        {
+            // Refinement and limit stencils go to the background; the preview stands in.
+            if (!_build || _build->numVertices != numVertices || _build->options != options ||
+                _build->params != params || _build->faceVertexCounts != faceVertexCounts ||
+                _build->faceIndices != faceIndices)
+            {
+                _StartLayoutBuildLocked(faceVertexCounts, faceIndices, layoutPoints, options, params);
+            }
+            options.refine = false;
+            if (isCurrent(_layout, options))
+            {
+                return;
+            }
+        }
+
+        // Unchanged topology usually arrives as the very same arrays, which avoids hashing entirely.
+        if (!_topology || !_topology->IsIdentical(faceVertexCounts, faceIndices, numVertices, options))
+        {
+            bool built = false;
+            _topology  = MyTopologyCache::GetInstance().Get(faceVertexCounts, faceIndices, numVertices, options, &built);
+            if (built && _stats)
+            {
+                _stats->AddRefinerRebuild();
+            }
+        }
+        _PublishLayoutLocked(_topology ? MyFurLayout::Create(_topology, params, layoutPoints.cdata()) : nullptr);
+    });
+    return _layout;
+}
+
+std::shared_ptr<MyFurEvaluator::_Visibility const>
+MyFurEvaluator::_GetVisibility(_State const& state, MyFurLayoutSharedPtr const& layout)
+{
+    TRACE_FUNCTION();
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_visibility && _visibility->generation == state.generation && _visibility->layout == layout)
+    {
+        return _visibility;
+    }
+
+    auto visibility            = std::make_shared<_Visibility>();
+    visibility->generation     = state.generation;
+    visibility->layout         = layout;
+    MyTopology const& topology = *layout->GetTopology();
+    VtVec3fArray points        = state.inputs.GetPoints(0.0f);
+    // Culling runs parallel loops; see FindMovedShards.
+    WorkWithScopedParallelism([&]() {
+        if (!_culling || !_culling->IsIdentical(topology.faceVertexCounts, topology.faceVertexIndices))
+        {
+            _culling = MyFurCulling::Create(topology);
+        }
+        if (_culling && int(points.size()) == topology.numVertices)
+        {
+            _culling->ComputeVisibleGuides(
+                *layout, points.cdata(), state.inputs.GetLength(0.0f), state.inputs.culling, &visibility->guides);
+        }
+        else
+        {
+            // Nothing to cull against, so everything stays.
+            visibility->guides.resize(layout->GetNumGuides());
+            std::iota(visibility->guides.begin(), visibility->guides.end(), 0);
+        }
+    });
+    TF_DEBUG(MYGP_FUR_LAYOUT)
+        .Msg("Culling keeps %zu of %d guides\n", visibility->guides.size(), layout->GetNumGuides());
+    // Like the guides, only the latest inputs are cached.
+    if (!_visibility || state.generation >= _visibility->generation)
+    {
+        _visibility = visibility;
+    }
+    return visibility;
+}
+
+bool
+MyFurEvaluator::_EvaluateIncremental(MyFurLayoutSharedPtr const& layout,
+                                     _State const& state,
+                                     int shard,
+                                     Time time,
+                                     VtVec3fArray const& points,
+                                     float length,
+                                     float clump,
+                                     size_t numCurves,
+                                     GfVec3f* out)
+{
+    static int const percent = TfGetEnvSetting(MYGP_FUR_INCREMENTAL_PERCENT);
+    if (percent <= 0)
+    {
+        return false;
+    }
+    _Retained retained;
+    {
+        std::lock_guard<std::mutex> lock(_retainedMutex);
+        if (size_t(shard) >= _retained.size())
+        {
+            return false;
+        }
+        auto const& entries = _retained[shard];
+        auto it             = std::find_if(
+            entries.begin(), entries.end(), [&](_Retained const& r) { return r.time == time; });
+        if (it == entries.end())
+        {
+            return false;
+        }
+        retained = *it;
+    }
+    // Anything but the points changing moves every curve.
+    if (retained.layout != layout || retained.numShards != state.numShards || retained.length != length ||
+        retained.clump != clump || retained.points.size() != points.size() || retained.result.size() != 2 * numCurves)
+    {
+        return false;
+    }
+
+    TRACE_FUNCTION();
+    std::shared_ptr<_Diff const> diff = _GetDiff(layout, retained.points, points);
+    constexpr int W                   = MyFurStencils::SliceWidth;
+    MyFurStencils const* stencils     = layout->GetStencils();
+    MyFurChildren const* children     = layout->GetChildren();
+    int childrenPerGuide              = children ? layout->GetParams().childrenPerGuide : 0;
+    std::pair<int, int> guides        = shardGuides(layout->GetNumGuides(), state.numShards, shard);
+    size_t sliceBegin                 = size_t(guides.first) / W;
+    size_t sliceEnd                   = (size_t(guides.second) + W - 1) / W;
+    std::vector<char> const& dirty    = diff->dirtySlices;
+
+    // Children reach for guides anywhere on the mesh, so they go by the mesh-wide share.
+    size_t numSlices = children ? dirty.size() : sliceEnd - sliceBegin;
+    size_t numDirty  = children ? diff->numDirtySlices
+                                : size_t(std::count(dirty.begin() + sliceBegin, dirty.begin() + sliceEnd, char(1)));
+    if (numDirty * 100 > numSlices * size_t(percent))
+    {
+        return false;
+    }
+
+    std::copy(retained.result.cdata(), retained.result.cdata() + 2 * numCurves, out);
+    if (numDirty == 0)
+    {
+        return true;
+    }
+    if (!children)
+    {
+        TRACE_SCOPE("Patch guides");
+        WorkParallelForN(sliceEnd - sliceBegin, [&](size_t begin, size_t end) {
+            for (size_t slice = sliceBegin + begin; slice < sliceBegin + end; ++slice)
+            {
+                if (dirty[slice])
+                {
+                    stencils->EvaluateCurves(points.cdata(), length, slice, slice + 1, out, guides.first);
+                }
+            }
+        });
+        return true;
+    }
+
+    // The guides are evaluated in full and shared as usual; only the children blending a
+    // guide of a dirty slice are blended again.
+    VtVec3fArray allGuides;
+    GfVec3f const* in = points.cdata();
+    _GetGuides(layout, state.generation, 1, &time, &in, &length, false, &allGuides);
+    std::copy(allGuides.cdata() + 2 * size_t(guides.first), allGuides.cdata() + 2 * size_t(guides.second), out);
+    size_t numGuides  = size_t(guides.second - guides.first);
+    size_t firstChild = size_t(guides.first) * childrenPerGuide;
+    TRACE_SCOPE("Patch children");
+    WorkParallelForN(numGuides * childrenPerGuide, [&](size_t begin, size_t end) {
+        auto isDirty = [&](size_t child) {
+            int const* g = children->GetGuides(firstChild + child);
+            return dirty[g[0] / W] || dirty[g[1] / W] || dirty[g[2] / W];
+        };
+        // Runs of dirty children go through one call.
+        for (size_t child = begin; child < end;)
+        {
+            if (!isDirty(child))
+            {
+                ++child;
+                continue;
+            }
+            size_t run = child + 1;
+            while (run < end && isDirty(run))
+            {
+                ++run;
+            }
+            children->Evaluate(
+                allGuides.cdata(), clump, firstChild + child, firstChild + run, out + 2 * (numGuides + child));
+            child = run;
+        }
+    });
+    return true;
+}
+
+void
+MyFurEvaluator::_Retain(int numShards,
+                        int shard,
+                        Time time,
+                        MyFurLayoutSharedPtr const& layout,
+                        VtVec3fArray const& points,
+                        float length,
+                        float clump,
+                        VtVec3fArray const& result)
+{
+    std::lock_guard<std::mutex> lock(_retainedMutex);
+    if (_retained.size() < size_t(numShards))
+    {
+        _retained.resize(numShards);
+    }
+    // Most recently stored last, so the shutter offsets in use outlive stray ones.
+    auto& entries = _retained[shard];
+    auto it       = std::find_if(entries.begin(), entries.end(), [&](_Retained const& r) { return r.time == time; });
+    if (it != entries.end())
+    {
+        entries.erase(it);
+    }
+    else if (entries.size() >= MaxTimes)
+    {
+        entries.erase(entries.begin());
+    }
+    _Retained retained;
+    retained.time      = time;
+    retained.layout    = layout;
+    retained.numShards = numShards;
+    retained.length    = length;
+    retained.clump     = clump;
+    retained.points    = points;
+    retained.result    = result;
+    entries.push_back(std::move(retained));
+}
+
+std::shared_ptr<MyFurEvaluator::_Diff const>
+MyFurEvaluator::_GetDiff(MyFurLayoutSharedPtr const& layout, VtVec3fArray const& before, VtVec3fArray const& after)
+{
+    TRACE_FUNCTION();
+    std::lock_guard<std::mutex> lock(_mutex);
+    // Every shard of a frame diffs the same pair of arrays.
+    if (_diff && _diff->layout == layout && _diff->before.IsIdentical(before) && _diff->after.IsIdentical(after))
+    {
+        return _diff;
+    }
+
+    auto diff    = std::make_shared<_Diff>();
+    diff->layout = layout;
+    diff->before = before;
+    diff->after  = after;
+
+    MyFurStencils const* stencils = layout->GetStencils();
+    size_t numSlices              = stencils->GetNumSlices();
+    size_t numVertices            = after.size();
+    diff->dirtySlices.assign(numSlices, 0);
+    // Parallel loops under the lock; see FindMovedShards.
+    WorkWithScopedParallelism([&]() {
+        // Control vertex to slices map, the transpose of what the stencils read.
+        if (_cvSlicesLayout != layout)
+        {
+            constexpr int W = MyFurStencils::SliceWidth;
+            std::vector<std::vector<int>> sliceCvs(numSlices);
+            WorkParallelForN(numSlices, [&](size_t begin, size_t end) {
+                for (size_t slice = begin; slice < end; ++slice)
+                {
+                    std::vector<int>& cvs = sliceCvs[slice];
+                    int last              = std::min(int(slice + 1) * W, stencils->GetNumStencils());
+                    for (int stencil = int(slice) * W; stencil < last; ++stencil)
+                    {
+                        stencils->AppendControlVertices(stencil, &cvs);
+                    }
+                    std::sort(cvs.begin(), cvs.end());
+                    cvs.erase(std::unique(cvs.begin(), cvs.end()), cvs.end());
+                }
+            });
+            _cvSliceOffsets.assign(numVertices + 1, 0);
+            for (std::vector<int> const& cvs : sliceCvs)
+            {
+                for (int cv : cvs)
+                {
+                    ++_cvSliceOffsets[cv + 1];
+                }
+            }
+            std::partial_sum(_cvSliceOffsets.begin(), _cvSliceOffsets.end(), _cvSliceOffsets.begin());
+            _cvSlices.resize(_cvSliceOffsets.back());
+            std::vector<int> fill(_cvSliceOffsets.begin(), _cvSliceOffsets.end() - 1);
+            for (size_t slice = 0; slice < numSlices; ++slice)
+            {
+                for (int cv : sliceCvs[slice])
+                {
+                    _cvSlices[fill[cv]++] = int(slice);
+                }
+            }
+            _cvSlicesLayout = layout;
+        }
+
+        _changed.resize(numVertices);
+        WorkParallelForN(numVertices, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                _changed[i] = before[i] != after[i];
+            }
+        });
+    });
+    for (size_t cv = 0; cv < numVertices; ++cv)
+    {
+        if (_changed[cv])
+        {
+            for (int i = _cvSliceOffsets[cv]; i < _cvSliceOffsets[cv + 1]; ++i)
+            {
+                diff->dirtySlices[_cvSlices[i]] = 1;
+            }
+        }
+    }
+    diff->numDirtySlices = size_t(std::count(diff->dirtySlices.begin(), diff->dirtySlices.end(), char(1)));
+    _diff                = diff;
+    return diff;
+}
+
+void
+MyFurEvaluator::_StartLayoutBuildLocked(VtIntArray const& faceVertexCounts,
+                                        VtIntArray const& faceIndices,
+                                        VtVec3fArray const& points,
+                                        MyTopologyOptions const& options,
+                                        MyFurLayoutParams const& params)
+{
+    auto build              = std::make_shared<_LayoutBuild>();
+    build->faceVertexCounts = faceVertexCounts;
+    build->faceIndices      = faceIndices;
+    build->numVertices      = int(points.size());
+    build->options          = options;
+    build->params           = params;
+    _build                  = build;
+    TF_DEBUG(MYGP_FUR_LAYOUT).Msg("Starting background layout build for %d vertices\n", build->numVertices);
+
+    MyProceduralStatsSharedPtr stats = _stats;
+    _dispatcher.Run([build, points, stats]() {
+        TRACE_SCOPE("Background layout build");
+        bool built                   = false;
+        MyTopologySharedPtr topology = MyTopologyCache::GetInstance().Get(
+            build->faceVertexCounts, build->faceIndices, build->numVertices, build->options, &built);
+        if (built && stats)
+        {
+            stats->AddRefinerRebuild();
+        }
+        if (topology)
+        {
+            build->layout = MyFurLayout::Create(topology, build->params, points.cdata());
+        }
+        build->done = true;
+    });
+}
+
+void
+MyFurEvaluator::_AdoptLayoutBuildLocked()
+{
+    if (!_build || !_build->done)
+    {
+        return;
+    }
+    // Even a build that is already stale is closer to the inputs than the preview; the
+    // next _GetLayout replaces it if needed.
+    if (_build->layout)
+    {
+        _topology = _build->layout->GetTopology();
+        _PublishLayoutLocked(_build->layout);
+    }
+    _build.reset();
+}
+
+void
+MyFurEvaluator::_PublishLayoutLocked(MyFurLayoutSharedPtr const& layout)
+{
+    // Writers hold _mutex; readers outside of it go through atomic_load.
+    std::atomic_store(&_layout, layout);
+}
+
+void
+MyFurEvaluator::SetAsync(bool async)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _async = async && WorkGetConcurrencyLimit() > 1;
+}
+
+void
+MyFurEvaluator::RequestLayout(Time shutterOffset)
+{
+    MyFurInputs inputs = GetInputs();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (!_async)
+        {
+            return;
+        }
+    }
+    if (inputs.faceVertexCounts && inputs.faceIndices && inputs.points)
+    {
+        _GetLayout(inputs, shutterOffset, inputs.GetPoints(shutterOffset));
+    }
+}
+
+bool
+MyFurEvaluator::PollLayoutBuild()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    MyFurLayoutSharedPtr previous = _layout;
+    _AdoptLayoutBuildLocked();
+    return _layout != previous;
+}
+
+void
+MyFurEvaluator::StartLookAhead()
+{
+    uint64_t generation = ++_lookAheadGeneration;
+    if (GetInputs().GetLookAheadFrames() <= 0)
+    {
+        std::lock_guard<std::mutex> lock(_ringMutex);
+        _ring.clear();
+        return;
+    }
+    _dispatcher.Run([this, generation]() { _RunLookAhead(generation); });
+}
+
+void
+MyFurEvaluator::_RunLookAhead(uint64_t generation)
+{
+    TRACE_FUNCTION();
+    MyFurInputs inputs = GetInputs();
+    int numFrames      = inputs.GetLookAheadFrames();
+    int numShards      = GetNumShards();
+    // Only worth it when the points actually change over the frames ahead.
+    std::vector<Time> sampleTimes;
+    if (!inputs.points || !inputs.points->GetContributingSampleTimesForInterval(1.0f, Time(numFrames), &sampleTimes))
+    {
+        return;
+    }
+    // Work has no task priorities, so the look-ahead goes one shard and frame at a time and
+    // gives up as soon as the inputs move on (a new frame, a scrub or an edit). Evaluate
+    // stores what it computes in the ring and returns early for what is already there.
+    for (int frame = 1; frame <= numFrames; ++frame)
+    {
+        Time time = Time(frame);
+        for (int shard = 0; shard < numShards; ++shard)
+        {
+            if (_lookAheadGeneration != generation)
+            {
+                return;
+            }
+            VtVec3fArray result;
+            bool evaluated;
+            _Evaluate(shard, 1, &time, &result, &evaluated, true);
+        }
+    }
+}
+
+bool
+MyFurEvaluator::_FindLookAhead(MyFurBakeCache::Key const& key, VtVec3fArray* result)
+{
+    std::lock_guard<std::mutex> lock(_ringMutex);
+    for (auto const& entry : _ring)
+    {
+        if (entry.first == key)
+        {
+            *result = entry.second;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+MyFurEvaluator::_StoreLookAhead(MyFurBakeCache::Key const& key, VtVec3fArray const& result, size_t capacity)
+{
+    std::lock_guard<std::mutex> lock(_ringMutex);
+    _ring.emplace_back(key, result);
+    while (_ring.size() > capacity)
+    {
+        _ring.pop_front();
+    }
+}
+
+void
+MyFurEvaluator::_GetBakeKeys(MyFurInputs const& inputs,
+                             int numShards,
+                             int shard,
+                             size_t numTimes,
+                             Time const* times,
+                             VtVec3fArray const* points,
+                             MyFurBakeCache::Key* keys)
+{
+    TRACE_FUNCTION();
+    VtIntArray faceVertexCounts = inputs.GetFaceVertexCounts(times[0]);
+    VtIntArray faceIndices      = inputs.GetFaceIndices(times[0]);
+    MyFurLayoutParams params    = inputs.GetLayoutParams(times[0]);
+    MyTopologyOptions options   = inputs.GetTopologyOptions(times[0]);
+
+    MyFurBakeCache::KeyBuilder layoutKey;
+    layoutKey.Append(_HashTopology(faceVertexCounts, faceIndices))
+        .Append(points[0].size())
+        .Append(options.scheme)
+        .Append(options.boundary)
+        .Append(options.refine)
+        .Append(options.isolationLevel)
+        .Append(options.endCap)
+        .Append(options.refine && MyFurLayout::UsesPatchKernels()) // the builders differ by rounding
+        .Append(params.numSamplesPerFace)
+        .Append(params.maxCurves)
+        .Append(params.childrenPerGuide)
+        .Append(params.density.cdata(), params.density.size() * sizeof(float));
+    // The pose the roots were spread over, as _GetLayout picks it.
+    if (params.maxCurves > 0 || params.childrenPerGuide > 0)
+    {
+        bool useRest = params.rest.size() == points[0].size();
+        layoutKey.Append(useRest ? _HashRest(params.rest) : _HashPoints(points[0]));
+    }
+    // Visibility follows the camera and the points and length at time 0.
+    if (inputs.culling.enabled)
+    {
+        MyFurCullingParams const& culling = inputs.culling;
+        layoutKey.Append(culling.viewProjection)
+            .Append(culling.position)
+            .Append(culling.viewDirection)
+            .Append(culling.orthographic)
+            .Append(culling.margin)
+            .Append(culling.backfaces)
+            .Append(culling.falloffDistance)
+            .Append(_HashPoints(inputs.GetPoints(0.0f)))
+            .Append(inputs.GetLength(0.0f));
+    }
+
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        MyFurBakeCache::KeyBuilder key = layoutKey;
+        key.Append(_HashPoints(points[i]))
+            .Append(points[i].size())
+            .Append(inputs.GetLength(times[i]))
+            .Append(inputs.GetClump(times[i]))
+            .Append(numShards)
+            .Append(shard);
+        keys[i] = key.Get();
+    }
+}
+
+uint64_t
+MyFurEvaluator::_HashPoints(VtVec3fArray const& points)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto const& entry : _pointsHashes)
+        {
+            if (entry.first.IsIdentical(points))
+            {
+                return entry.second;
+            }
+        }
+    }
+    // Hashed outside the lock; shards racing on the same array only repeat the work.
+    uint64_t hash = ArchHash64(reinterpret_cast<char const*>(points.cdata()), points.size() * sizeof(GfVec3f));
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (_pointsHashes.size() >= MaxTimes)
+    {
+        _pointsHashes.erase(_pointsHashes.begin());
+    }
+    _pointsHashes.emplace_back(points, hash);
+    return hash;
+}
+
+uint64_t
+MyFurEvaluator::_HashTopology(VtIntArray const& faceVertexCounts, VtIntArray const& faceIndices)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_hashedCounts.IsIdentical(faceVertexCounts) && _hashedIndices.IsIdentical(faceIndices))
+        {
+            return _topologyHash;
+        }
+    }
+    uint64_t hash = ArchHash64(reinterpret_cast<char const*>(faceVertexCounts.cdata()),
+                               faceVertexCounts.size() * sizeof(int));
+    hash          = ArchHash64(reinterpret_cast<char const*>(faceIndices.cdata()), faceIndices.size() * sizeof(int), hash);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _hashedCounts  = faceVertexCounts;
+    _hashedIndices = faceIndices;
+    _topologyHash  = hash;
+    return hash;
+}
+
+uint64_t
+MyFurEvaluator::_HashRest(VtVec3fArray const& rest)
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_hashedRest.IsIdentical(rest))
+        {
+            return _restHash;
+        }
+    }
+    uint64_t hash = ArchHash64(reinterpret_cast<char const*>(rest.cdata()), rest.size() * sizeof(GfVec3f));
+    std::lock_guard<std::mutex> lock(_mutex);
+    _hashedRest = rest;
+    _restHash   = hash;
+    return hash;
+}
+
+void
+MyFurEvaluator::_GetGuides(MyFurLayoutSharedPtr const& layout,
+                           uint64_t generation,
+                           size_t numTimes,
+                           Time const* times,
+                           GfVec3f const* const* points,
+                           float const* lengths,
+                           bool lookAhead,
+                           VtVec3fArray* guides)
+{
+    TRACE_FUNCTION();
+    // Guides are cached per time for the latest inputs only. An evaluation still running on
+    // older inputs computes its own and leaves the cache alone. A look-ahead goes through
+    // its frames one at a time, so it keeps just the frame its shards are on.
+    _GuideCache& cache = lookAhead ? _lookAheadGuides : _guides;
+    size_t capacity    = lookAhead ? 1 : MaxTimes;
+
+    TfSmallVector<GfVec3f const*, MaxTimes> in;
+    TfSmallVector<float, MaxTimes> missingLengths;
+    TfSmallVector<GfVec3f*, MaxTimes> out;
+    TfSmallVector<size_t, MaxTimes> missing;
+    TfSmallVector<std::promise<VtVec3fArray>, MaxTimes> claimed; // per missing time, when cached
+    TfSmallVector<std::shared_future<VtVec3fArray>, MaxTimes> pending(numTimes);
+    {
+        // Only lookups and claims under the lock; the guides are evaluated outside of it.
+        std::lock_guard<std::mutex> lock(_guidesMutex);
+        bool cached = generation >= cache.generation;
+        if (cached && (cache.layout != layout || cache.generation != generation))
+        {
+            cache.layout     = layout;
+            cache.generation = generation;
+            cache.entries.clear();
+        }
+        for (size_t i = 0; i < numTimes; ++i)
+        {
+            auto it = std::find_if(
+                cache.entries.begin(), cache.entries.end(), [&](auto const& entry) { return entry.first == times[i]; });
+            if (cached && it != cache.entries.end())
+            {
+                pending[i] = it->second;
+                continue;
+            }
+            missing.push_back(i);
+            if (cached)
+            {
+                if (cache.entries.size() >= capacity)
+                {
+                    cache.entries.erase(cache.entries.begin());
+                }
+                claimed.emplace_back();
+                cache.entries.emplace_back(times[i], claimed.back().get_future().share());
+            }
+        }
+    }
+
+    for (size_t i : missing)
+    {
+        GfVec3f* data = nullptr;
+        guides[i]     = _pool.Allocate(2 * size_t(layout->GetNumGuides()), &data);
+        in.push_back(points[i]);
+        missingLengths.push_back(lengths[i]);
+        out.push_back(data);
+    }
+    if (!missing.empty())
+    {
+        // Isolated, so this thread never picks up a shard task that would wait on the times
+        // it claimed.
+        MyFurStencils const* stencils = layout->GetStencils();
+        WorkWithScopedParallelism([&]() {
+            WorkParallelForN(stencils->GetNumSlices(), [&](size_t begin, size_t end) {
+                stencils->EvaluateCurves(missing.size(), in.data(), missingLengths.data(), begin, end, out.data());
+            });
+        });
+        for (size_t j = 0; j < claimed.size(); ++j)
+        {
+            claimed[j].set_value(guides[missing[j]]);
+        }
+    }
+    // Times claimed by other evaluations, which are done or finish without waiting on this one.
+    for (size_t i = 0; i < numTimes; ++i)
+    {
+        if (pending[i].valid())
+        {
+            guides[i] = pending[i].get();
+        }
+    }
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
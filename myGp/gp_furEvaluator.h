@@ -0,0 +1,286 @@
+#pragma once
+
+#include "gp_arrayPool.h"
+#include "gp_furBakeCache.h"
+#include "gp_furCulling.h"
+#include "gp_furLayout.h"
+#include "gp_stats.h"
+#include "gp_topologyCache.h"
+
+#include <pxr/base/tf/smallVector.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/base/work/dispatcher.h>
+#include <pxr/imaging/hd/dataSource.h>
+#include <pxr/pxr.h>
+
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Scene inputs of the fur, refreshed by the procedural on every Update.
+struct MyFurInputs
+{
+    using Time = HdSampledDataSource::Time;
+
+    HdSampledDataSourceHandle points, faceVertexCounts, faceIndices, density;
+    HdSampledDataSourceHandle numSamplesPerFace, length, maxCurves, childrenPerGuide, clump, quality;
+    HdSampledDataSourceHandle lookAheadFrames;
+    // Resolved from the culling camera by the procedural; disabled when there is none.
+    MyFurCullingParams culling;
+    // Rest pose of the source mesh, resolved by the procedural; see MyFurLayoutParams::rest.
+    VtVec3fArray rest;
+    // Share of the maxCurves budget for this source mesh, as a range of the cumulative weights
+    // of all meshes of the procedural: it gets floor(N * end) - floor(N * begin) curves, so
+    // the shares of all meshes add up to exactly N.
+    double budgetBegin = 0.0;
+    double budgetEnd   = 1.0;
+
+    // Arrays are read through the typed interface, without boxing them into a VtValue.
+    VtVec3fArray GetPoints(Time shutterOffset) const;
+    VtIntArray GetFaceVertexCounts(Time shutterOffset) const;
+    VtIntArray GetFaceIndices(Time shutterOffset) const;
+    MyFurLayoutParams GetLayoutParams(Time shutterOffset) const;
+    float GetLength(Time shutterOffset) const;
+    float GetClump(Time shutterOffset) const;
+    // Refinement for the quality tier: "full" (limit surface, Gregory end caps, the default),
+    // "medium" (low isolation level, B-spline end caps) or "preview" (bilinear control cage,
+    // no OpenSubdiv at all).
+    MyTopologyOptions GetTopologyOptions(Time shutterOffset) const;
+    // Frames evaluated ahead during playback, 0 (the default) to disable it. Also 0 with
+    // culling, whose keys follow the current frame's points and so would never be hit, and
+    // when Work runs single-threaded, as nothing would run the look-ahead.
+    int GetLookAheadFrames() const;
+};
+
+// Evaluates the fur of one procedural, split into shards. Every shard is a contiguous,
+// slice-aligned run of guides in ptex face order together with their children, so shards
+// cover contiguous ranges of faces. Topology, layout and (in guide/child mode) the full
+// set of guide curves are shared by all shards.
+class MyFurEvaluator
+{
+public:
+    using Time = HdSampledDataSource::Time;
+
+    // Time samples one Evaluate call handles without touching the heap.
+    static constexpr size_t MaxTimes = 8;
+
+    // Work done by the evaluator is accounted to stats, when given.
+    explicit MyFurEvaluator(MyProceduralStatsSharedPtr const& stats = nullptr);
+    ~MyFurEvaluator();
+
+    void SetInputs(MyFurInputs const& inputs, int numShards);
+    MyFurInputs GetInputs() const;
+    int GetNumShards() const;
+
+    // Guides [first, second) of a shard when there are numGuides guides in total.
+    std::pair<int, int> GetShardGuides(int numGuides, int shard) const;
+    // Number of curves of a shard at the given time. Builds nothing unless culling is
+    // enabled, as the curves that survive it depend on the layout.
+    int ComputeNumCurves(int shard, Time shutterOffset);
+
+    // Writes the (root, tip) pairs of a shard for each of numTimes times into results. The
+    // layout follows the first time; a sample whose point count does not match it is skipped
+    // and reported through evaluated. Once the layout is built and the output buffers have
+    // come back to the pool, this does not allocate for up to MaxTimes samples (except for
+    // some bookkeeping when culling).
+    // A single sample whose points differ from the shard's previous result at the same
+    // shutter offset in only a few control vertices copies that result and re-evaluates
+    // just the slices (or children) those vertices reach.
+    void Evaluate(int shard, size_t numTimes, Time const* times, VtVec3fArray* results, bool* evaluated);
+
+    // Marks the shards with a curve that reads a control vertex differing between before
+    // and after. Returns false when that cannot be told, e.g. before the first evaluation.
+    bool FindMovedShards(VtVec3fArray const& before, VtVec3fArray const& after, std::vector<bool>* moved);
+
+    // Drops the cached guide curves and point hashes.
+    void Invalidate();
+
+    // With async rebuilds, a layout that needs the refiner is built by a background task and
+    // evaluation uses the bilinear preview layout until it is picked up. Ignored when Work
+    // runs single-threaded, as nothing would run the task.
+    void SetAsync(bool async);
+    // Starts building the layout for the current inputs when async rebuilds are enabled.
+    void RequestLayout(Time shutterOffset);
+    // Picks up a finished background build. Returns true when that replaced the layout, so
+    // the curve points need to be dirtied.
+    bool PollLayoutBuild();
+
+    // Cancels a running look-ahead and, when the inputs ask for one, starts evaluating every
+    // shard at the next frame offsets over which the points are animated. The results go
+    // to a small ring keyed like the bake cache, which Evaluate serves from once the same
+    // points arrive as the current frame.
+    void StartLookAhead();
+
+private:
+    // Inputs as of one SetInputs. Published whole and never modified, so readers take a
+    // reference without locking; generation tells evaluations of different inputs apart.
+    struct _State
+    {
+        MyFurInputs inputs;
+        int numShards       = 1;
+        uint64_t generation = 0;
+    };
+
+    // Guides that survive culling for the inputs of one generation. Sampled once from the
+    // points at time 0, so every shutter sample of a frame gets the same curves.
+    struct _Visibility
+    {
+        uint64_t generation = 0;
+        MyFurLayoutSharedPtr layout;
+        std::vector<int> guides; // ascending
+    };
+
+    // Last single-sample result of a shard at one shutter offset, which the next frame
+    // patches when only part of the mesh moved.
+    struct _Retained
+    {
+        Time time = 0.0f;
+        MyFurLayoutSharedPtr layout;
+        int numShards = 0;
+        float length  = 0.0f;
+        float clump   = 0.0f;
+        VtVec3fArray points, result;
+    };
+
+    // All guide curves per time, for one layout and the inputs of one generation. A time is
+    // claimed by the evaluation that finds it missing and filled in once that is done, so
+    // the shards of a frame evaluate its guides once.
+    struct _GuideCache
+    {
+        MyFurLayoutSharedPtr layout;
+        uint64_t generation = 0;
+        TfSmallVector<std::pair<Time, std::shared_future<VtVec3fArray>>, MaxTimes> entries;
+    };
+
+    // Slices of layout that read a control vertex differing between before and after.
+    struct _Diff
+    {
+        MyFurLayoutSharedPtr layout;
+        VtVec3fArray before, after;
+        std::vector<char> dirtySlices;
+        size_t numDirtySlices = 0;
+    };
+
+    // Inputs and result of a background layout build. The task keeps its own reference, so
+    // a build that a newer request superseded just finishes into nothing.
+    struct _LayoutBuild
+    {
+        VtIntArray faceVertexCounts, faceIndices;
+        int numVertices = 0;
+        MyTopologyOptions options;
+        MyFurLayoutParams params;
+        MyFurLayoutSharedPtr layout;
+        std::atomic<bool> done{ false };
+    };
+
+    void _StartLayoutBuildLocked(VtIntArray const& faceVertexCounts,
+                                 VtIntArray const& faceIndices,
+                                 VtVec3fArray const& points,
+                                 MyTopologyOptions const& options,
+                                 MyFurLayoutParams const& params);
+    void _AdoptLayoutBuildLocked();
+    void _PublishLayoutLocked(MyFurLayoutSharedPtr const& layout);
+    std::shared_ptr<_State const> _GetState() const;
+    // Evaluate, which a look-ahead calls with lookAhead set: its frames are not the ones
+    // Update asks for next, so they neither replace the retained results nor the cached
+    // guides of the current frame.
+    void _Evaluate(
+        int shard, size_t numTimes, Time const* times, VtVec3fArray* results, bool* evaluated, bool lookAhead);
+    void _RunLookAhead(uint64_t generation);
+    bool _FindLookAhead(MyFurBakeCache::Key const& key, VtVec3fArray* result);
+    void _StoreLookAhead(MyFurBakeCache::Key const& key, VtVec3fArray const& result, size_t capacity);
+    MyFurLayoutSharedPtr _GetLayout(MyFurInputs const& inputs, Time shutterOffset, VtVec3fArray const& points);
+    std::shared_ptr<_Visibility const> _GetVisibility(_State const& state, MyFurLayoutSharedPtr const& layout);
+    bool _EvaluateIncremental(MyFurLayoutSharedPtr const& layout,
+                              _State const& state,
+                              int shard,
+                              Time time,
+                              VtVec3fArray const& points,
+                              float length,
+                              float clump,
+                              size_t numCurves,
+                              GfVec3f* out);
+    void _Retain(int numShards,
+                 int shard,
+                 Time time,
+                 MyFurLayoutSharedPtr const& layout,
+                 VtVec3fArray const& points,
+                 float length,
+                 float clump,
+                 VtVec3fArray const& result);
+    std::shared_ptr<_Diff const> _GetDiff(MyFurLayoutSharedPtr const& layout,
+                                          VtVec3fArray const& before,
+                                          VtVec3fArray const& after);
+    void _GetBakeKeys(MyFurInputs const& inputs,
+                      int numShards,
+                      int shard,
+                      size_t numTimes,
+                      Time const* times,
+                      VtVec3fArray const* points,
+                      MyFurBakeCache::Key* keys);
+    uint64_t _HashPoints(VtVec3fArray const& points);
+    uint64_t _HashTopology(VtIntArray const& faceVertexCounts, VtIntArray const& faceIndices);
+    uint64_t _HashRest(VtVec3fArray const& rest);
+    void _GetGuides(MyFurLayoutSharedPtr const& layout,
+                    uint64_t generation,
+                    size_t numTimes,
+                    Time const* times,
+                    GfVec3f const* const* points,
+                    float const* lengths,
+                    bool lookAhead,
+                    VtVec3fArray* guides);
+
+    MyProceduralStatsSharedPtr const _stats;
+    mutable std::mutex _mutex;
+    std::shared_ptr<_State const> _state; // atomic_load / atomic_store only
+    MyTopologySharedPtr _topology;
+    MyFurLayoutSharedPtr _layout; // written under _mutex, read with atomic_load
+    MyVec3fArrayPool _pool;
+
+    // Control vertices read by each shard, for _influenceLayout split into _influence.size() shards.
+    MyFurLayoutSharedPtr _influenceLayout;
+    std::vector<std::vector<int>> _influence;
+    std::vector<char> _changed, _shardMoved; // scratch, kept across frames
+
+    // Guides of the current frame, and of the one frame a look-ahead is working through.
+    // Their own lock, held only to look up and publish, so evaluating guides never blocks
+    // the readers of _mutex.
+    std::mutex _guidesMutex;
+    _GuideCache _guides, _lookAheadGuides;
+
+    // Slices reading each control vertex, for _cvSlicesLayout, and the latest diff.
+    MyFurLayoutSharedPtr _cvSlicesLayout;
+    std::vector<int> _cvSliceOffsets, _cvSlices;
+    std::shared_ptr<_Diff const> _diff;
+    // Per shard, the results partial deformations are patched into.
+    std::mutex _retainedMutex;
+    std::vector<TfSmallVector<_Retained, MaxTimes>> _retained;
+
+    // Face supports for culling, and what survived it for the latest inputs.
+    MyFurCullingSharedPtr _culling;
+    std::shared_ptr<_Visibility const> _visibility;
+
+    // Bake cache and look-ahead keys: content hashes of recent point arrays and of the topology.
+    TfSmallVector<std::pair<VtVec3fArray, uint64_t>, MaxTimes> _pointsHashes;
+    VtIntArray _hashedCounts, _hashedIndices;
+    uint64_t _topologyHash = 0;
+    VtVec3fArray _hashedRest;
+    uint64_t _restHash = 0;
+
+    bool _async = false;
+    std::shared_ptr<_LayoutBuild> _build; // latest request, null once picked up
+
+    // Bumped to cancel the running look-ahead.
+    std::atomic<uint64_t> _lookAheadGeneration{ 0 };
+    std::mutex _ringMutex;
+    std::deque<std::pair<MyFurBakeCache::Key, VtVec3fArray>> _ring; // oldest first
+    // Last, so destruction waits for running builds before anything else goes away.
+    WorkDispatcher _dispatcher;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,899 @@
+#include "gp_furLayout.h"
+#include "gp_debugCodes.h"
+#include "gp_random.h"
+
+#include "pxr/base/gf/range3d.h"
+#include "pxr/base/gf/vec3d.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
+
+#include <opensubdiv/far/patchMap.h>
+#include <opensubdiv/far/stencilTableFactory.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_ENV_SETTING(MYGP_FUR_STENCIL_BUILDER,
+                      "far",
+                      "Limit stencil builder: far (Far::LimitStencilTableFactory) or patch (kernels per patch type)");
+
+namespace {
+// Stream reserved for mesh-wide random values; ptex face indices never get this high.
+constexpr uint32_t globalStream = 0xffffffffu;
+
+inline int
+ptexFacesOf(int nverts)
+{
+    return nverts == 4 ? 1 : nverts;
+}
+
+// Guides a maxCurves budget leaves room for, so that guides and children together stay
+// within it.
+inline int
+guideBudget(MyFurLayoutParams const& params)
+{
+    return params.maxCurves / (1 + std::max(0, params.childrenPerGuide));
+}
+
+inline bool
+usesDensity(VtIntArray const& faceVertexCounts, MyFurLayoutParams const& params)
+{
+    return params.maxCurves > 0 && params.density.size() == faceVertexCounts.size();
+}
+
+// CSR stencil arrays (position and both derivatives), either borrowed from a Far limit
+// stencil table or built here (per patch type, or on the control cage when the topology
+// is not refined).
+struct StencilTable
+{
+    int numStencils        = 0;
+    int const* sizes       = nullptr;
+    int const* offsets     = nullptr;
+    int const* indices     = nullptr;
+    float const* weights   = nullptr;
+    float const* duWeights = nullptr;
+    float const* dvWeights = nullptr;
+
+    std::unique_ptr<OpenSubdiv::Far::LimitStencilTable const> limit;
+    std::vector<int> builtSizes, builtOffsets, builtIndices;
+    std::vector<float> builtWeights, builtDuWeights, builtDvWeights;
+};
+
+// Bilinear interpolation of each ptex face's control quad: the face itself for quads, and
+// (v[i], mid(v[i], v[i+1]), centroid, mid(v[i-1], v[i])) for sub-face i of other faces,
+// matching the ptex parameterization OpenSubdiv uses. Every stencil of a face reads all of
+// its vertices, so no index merging is needed.
+std::unique_ptr<StencilTable>
+createCageStencils(MyTopology const& topology, OpenSubdiv::Far::LimitStencilTableFactory::LocationArrayVec const& loc)
+{
+    TRACE_FUNCTION();
+    VtIntArray const& faceVertexCounts = topology.faceVertexCounts;
+    VtIntArray const& faceIndices      = topology.faceVertexIndices;
+
+    // Base face, corner and first face-vertex index of every ptex face.
+    std::vector<int> ptexFace, ptexCorner, ptexFirst;
+    for (int face = 0, first = 0; face < int(faceVertexCounts.size()); first += faceVertexCounts[face++])
+    {
+        int nverts = faceVertexCounts[face];
+        for (int corner = 0; corner < ptexFacesOf(nverts); ++corner)
+        {
+            ptexFace.push_back(face);
+            ptexCorner.push_back(nverts == 4 ? -1 : corner);
+            ptexFirst.push_back(first);
+        }
+    }
+
+    auto table = std::make_unique<StencilTable>();
+    std::vector<int> locationOffsets(loc.size() + 1, 0);
+    for (size_t i = 0; i < loc.size(); ++i)
+    {
+        int ptex = loc[i].ptexIdx;
+        if (ptex < 0 || ptex >= int(ptexFace.size()) ||
+            ptexFirst[ptex] + faceVertexCounts[ptexFace[ptex]] > int(faceIndices.size()))
+        {
+            return nullptr;
+        }
+        locationOffsets[i + 1] = locationOffsets[i] + loc[i].numLocations;
+    }
+    int numStencils = locationOffsets.back();
+    table->builtSizes.resize(numStencils);
+    table->builtOffsets.resize(numStencils);
+    for (size_t i = 0, offset = 0; i < loc.size(); ++i)
+    {
+        int nverts = faceVertexCounts[ptexFace[loc[i].ptexIdx]];
+        for (int stencil = locationOffsets[i]; stencil < locationOffsets[i + 1]; ++stencil)
+        {
+            table->builtSizes[stencil]   = nverts;
+            table->builtOffsets[stencil] = int(offset);
+            offset += nverts;
+        }
+    }
+    size_t numWeights = numStencils ? size_t(table->builtOffsets.back() + table->builtSizes.back()) : 0;
+    table->builtIndices.resize(numWeights);
+    table->builtWeights.resize(numWeights);
+    table->builtDuWeights.resize(numWeights);
+    table->builtDvWeights.resize(numWeights);
+
+    WorkParallelForN(loc.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            int ptex         = loc[i].ptexIdx;
+            int nverts       = faceVertexCounts[ptexFace[ptex]];
+            int corner       = ptexCorner[ptex];
+            int const* verts = faceIndices.cdata() + ptexFirst[ptex];
+            for (int k = 0; k < loc[i].numLocations; ++k)
+            {
+                float s = loc[i].s[k], t = loc[i].t[k];
+                // Bilinear basis of the control quad corners and its derivatives.
+                float const b[4]  = { (1 - s) * (1 - t), s * (1 - t), s * t, (1 - s) * t };
+                float const bu[4] = { -(1 - t), 1 - t, t, -t };
+                float const bv[4] = { -(1 - s), -s, s, 1 - s };
+
+                int offset  = table->builtOffsets[locationOffsets[i] + k];
+                int* idx    = table->builtIndices.data() + offset;
+                float* w    = table->builtWeights.data() + offset;
+                float* du   = table->builtDuWeights.data() + offset;
+                float* dv   = table->builtDvWeights.data() + offset;
+                auto spread = [&](float const* basis, float* out) {
+                    if (corner < 0)
+                    {
+                        std::copy(basis, basis + 4, out);
+                        return;
+                    }
+                    std::fill(out, out + nverts, basis[2] / float(nverts));
+                    out[corner] += basis[0] + 0.5f * (basis[1] + basis[3]);
+                    out[(corner + 1) % nverts] += 0.5f * basis[1];
+                    out[(corner + nverts - 1) % nverts] += 0.5f * basis[3];
+                };
+                std::copy(verts, verts + nverts, idx);
+                spread(b, w);
+                spread(bu, du);
+                spread(bv, dv);
+            }
+        }
+    });
+
+    table->numStencils = numStencils;
+    table->sizes       = table->builtSizes.data();
+    table->offsets     = table->builtOffsets.data();
+    table->indices     = table->builtIndices.data();
+    table->weights     = table->builtWeights.data();
+    table->duWeights   = table->builtDuWeights.data();
+    table->dvWeights   = table->builtDvWeights.data();
+    return table;
+}
+
+// Uniform cubic B-spline weights and their derivatives at t.
+inline void
+cubicBSpline(float t, float* b, float* d)
+{
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float u  = 1.0f - t;
+    b[0]     = u * u * u / 6.0f;
+    b[1]     = (3.0f * t3 - 6.0f * t2 + 4.0f) / 6.0f;
+    b[2]     = (-3.0f * t3 + 3.0f * t2 + 3.0f * t + 1.0f) / 6.0f;
+    b[3]     = t3 / 6.0f;
+    d[0]     = -0.5f * u * u;
+    d[1]     = 1.5f * t2 - 2.0f * t;
+    d[2]     = -1.5f * t2 + t + 0.5f;
+    d[3]     = 0.5f * t2;
+}
+
+// Folds the weights of the phantom row or column past each boundary edge (bit 0: t = 0,
+// 1: s = 1, 2: t = 1, 3: s = 0) into the two next to it, as the phantom points are
+// extrapolated from those.
+inline void
+foldBoundary(int boundary, float* w)
+{
+    if (boundary & 1)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            w[i + 4] += 2.0f * w[i];
+            w[i + 8] -= w[i];
+            w[i]     = 0.0f;
+        }
+    }
+    if (boundary & 2)
+    {
+        for (int i = 0; i < 16; i += 4)
+        {
+            w[i + 2] += 2.0f * w[i + 3];
+            w[i + 1] -= w[i + 3];
+            w[i + 3] = 0.0f;
+        }
+    }
+    if (boundary & 4)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            w[i + 8] += 2.0f * w[i + 12];
+            w[i + 4] -= w[i + 12];
+            w[i + 12] = 0.0f;
+        }
+    }
+    if (boundary & 8)
+    {
+        for (int i = 0; i < 16; i += 4)
+        {
+            w[i + 1] += 2.0f * w[i];
+            w[i + 2] -= w[i];
+            w[i]     = 0.0f;
+        }
+    }
+}
+
+// Regular patches (the bulk of any Catmark mesh, and every B-spline end cap): a fully
+// unrolled bicubic tensor product, with boundary and infinitely sharp edges folded in.
+struct RegularBasis
+{
+    static constexpr int NumCVs = 16;
+
+    static void Evaluate(OpenSubdiv::Far::PatchTable const& patchTable,
+                         OpenSubdiv::Far::PatchTable::PatchHandle const& handle,
+                         float s,
+                         float t,
+                         float* w,
+                         float* ds,
+                         float* dt)
+    {
+        OpenSubdiv::Far::PatchParam const& param = patchTable.GetPatchParam(handle);
+        param.Normalize(s, t);
+        // Derivatives with respect to the ptex face, not the (smaller) patch.
+        float scale = 1.0f / param.GetParamFraction<float>();
+        float bs[4], dbs[4], bt[4], dbt[4];
+        cubicBSpline(s, bs, dbs);
+        cubicBSpline(t, bt, dbt);
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                w[4 * i + j]  = bs[j] * bt[i];
+                ds[4 * i + j] = scale * dbs[j] * bt[i];
+                dt[4 * i + j] = scale * bs[j] * dbt[i];
+            }
+        }
+        if (int boundary = param.GetBoundary())
+        {
+            foldBoundary(boundary, w);
+            foldBoundary(boundary, ds);
+            foldBoundary(boundary, dt);
+        }
+    }
+};
+
+// Bilinear end caps and Gregory basis end caps go through Far's basis, still with a fixed
+// CV count.
+template <int N>
+struct FarBasis
+{
+    static constexpr int NumCVs = N;
+
+    static void Evaluate(OpenSubdiv::Far::PatchTable const& patchTable,
+                         OpenSubdiv::Far::PatchTable::PatchHandle const& handle,
+                         float s,
+                         float t,
+                         float* w,
+                         float* ds,
+                         float* dt)
+    {
+        patchTable.EvaluateBasis(handle, s, t, w, ds, dt);
+    }
+};
+
+// A limit location, the stencil it becomes and the patch it lies on.
+struct PatchSample
+{
+    int stencil;
+    float s, t;
+    OpenSubdiv::Far::PatchTable::PatchHandle const* handle;
+};
+
+struct StencilEntry
+{
+    int index;
+    float weight, du, dv;
+};
+
+// Samples [begin, end) of one kernel, composed by one task.
+struct SampleBlock
+{
+    size_t begin, end;
+};
+
+// Composes the basis of each sample's patch with the stencils of the patch points (refined
+// vertices and end cap points, factorized down to the control vertices) into a limit
+// stencil. Each block appends its stencils to its own entry list, in sample order, and
+// records their sizes by stencil index.
+template <class Basis>
+void
+composeSamples(OpenSubdiv::Far::PatchTable const& patchTable,
+               OpenSubdiv::Far::StencilTable const& pointStencils,
+               PatchSample const* samples,
+               SampleBlock const* blocks,
+               size_t numBlocks,
+               std::vector<StencilEntry>* blockEntries,
+               int* sizes)
+{
+    constexpr int N           = Basis::NumCVs;
+    int const* pointSizes     = pointStencils.GetSizes().data();
+    int const* pointOffsets   = pointStencils.GetOffsets().data();
+    int const* pointIndices   = pointStencils.GetControlIndices().data();
+    float const* pointWeights = pointStencils.GetWeights().data();
+    WorkParallelForN(numBlocks, [&](size_t begin, size_t end) {
+        std::vector<StencilEntry> gathered;
+        for (size_t block = begin; block < end; ++block)
+        {
+            std::vector<StencilEntry>& entries = blockEntries[block];
+            for (size_t i = blocks[block].begin; i < blocks[block].end; ++i)
+            {
+                PatchSample const& sample = samples[i];
+                float w[N], ds[N], dt[N];
+                Basis::Evaluate(patchTable, *sample.handle, sample.s, sample.t, w, ds, dt);
+                OpenSubdiv::Far::ConstIndexArray cvs = patchTable.GetPatchVertices(*sample.handle);
+
+                gathered.clear();
+                for (int k = 0; k < N; ++k)
+                {
+                    // Folded phantom points drop out here.
+                    if (w[k] == 0.0f && ds[k] == 0.0f && dt[k] == 0.0f)
+                    {
+                        continue;
+                    }
+                    int point = cvs[k];
+                    for (int j = pointOffsets[point]; j < pointOffsets[point] + pointSizes[point]; ++j)
+                    {
+                        float pw = pointWeights[j];
+                        gathered.push_back({ pointIndices[j], w[k] * pw, ds[k] * pw, dt[k] * pw });
+                    }
+                }
+                std::sort(gathered.begin(), gathered.end(), [](StencilEntry const& a, StencilEntry const& b) {
+                    return a.index < b.index;
+                });
+                size_t first = entries.size();
+                for (StencilEntry const& entry : gathered)
+                {
+                    if (entries.size() > first && entries.back().index == entry.index)
+                    {
+                        entries.back().weight += entry.weight;
+                        entries.back().du += entry.du;
+                        entries.back().dv += entry.dv;
+                    }
+                    else
+                    {
+                        entries.push_back(entry);
+                    }
+                }
+                sizes[sample.stencil] = int(entries.size() - first);
+            }
+        }
+    });
+}
+
+// Limit stencils without Far::LimitStencilTableFactory: locations are bucketed by the type
+// of patch they fall on and each bucket runs a basis kernel compiled for that type, instead
+// of Far's generic basis into 20-entry buffers with runtime CV counts. Buckets are split into
+// blocks composed in parallel. Returns null for anything it has no kernel for (e.g. Loop
+// patches) or a location outside every patch, which Far then handles as before.
+std::unique_ptr<StencilTable>
+createPatchStencils(MyTopology const& topology, OpenSubdiv::Far::LimitStencilTableFactory::LocationArrayVec const& loc)
+{
+    TRACE_FUNCTION();
+    using namespace OpenSubdiv;
+    Far::PatchTable const& patchTable = *topology.patchTable;
+
+    enum Kernel
+    {
+        KernelRegular,
+        KernelQuads,
+        KernelGregoryBasis,
+        NumKernels
+    };
+    auto kernelOf = [&](Far::PatchTable::PatchHandle const& handle) {
+        switch (patchTable.GetPatchArrayDescriptor(handle.arrayIndex).GetType())
+        {
+        case Far::PatchDescriptor::REGULAR:
+            return int(KernelRegular);
+        case Far::PatchDescriptor::QUADS:
+            return int(KernelQuads);
+        case Far::PatchDescriptor::GREGORY_BASIS:
+            return int(KernelGregoryBasis);
+        default:
+            return -1;
+        }
+    };
+
+    std::vector<int> locationOffsets(loc.size() + 1, 0);
+    for (size_t i = 0; i < loc.size(); ++i)
+    {
+        locationOffsets[i + 1] = locationOffsets[i] + loc[i].numLocations;
+    }
+    int numStencils = locationOffsets.back();
+
+    // Patch lookup, then a stable counting sort of the samples by kernel.
+    std::vector<PatchSample> located(numStencils);
+    std::vector<signed char> kernels(numStencils);
+    std::atomic<bool> unsupported{ false };
+    Far::PatchMap patchMap(patchTable);
+    WorkParallelForN(loc.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            for (int k = 0; k < loc[i].numLocations; ++k)
+            {
+                int stencil         = locationOffsets[i] + k;
+                PatchSample& sample = located[stencil];
+                sample.stencil      = stencil;
+                sample.s            = loc[i].s[k];
+                sample.t            = loc[i].t[k];
+                sample.handle       = patchMap.FindPatch(loc[i].ptexIdx, sample.s, sample.t);
+                int kernel          = sample.handle ? kernelOf(*sample.handle) : -1;
+                kernels[stencil]    = (signed char)kernel;
+                if (kernel < 0)
+                {
+                    unsupported = true;
+                }
+            }
+        }
+    });
+    if (unsupported)
+    {
+        return nullptr;
+    }
+    size_t kernelOffsets[NumKernels + 1] = {};
+    for (signed char kernel : kernels)
+    {
+        ++kernelOffsets[kernel + 1];
+    }
+    std::partial_sum(kernelOffsets, kernelOffsets + NumKernels + 1, kernelOffsets);
+    std::vector<PatchSample> samples(numStencils);
+    size_t fill[NumKernels];
+    std::copy(kernelOffsets, kernelOffsets + NumKernels, fill);
+    for (int stencil = 0; stencil < numStencils; ++stencil)
+    {
+        samples[fill[kernels[stencil]]++] = located[stencil];
+    }
+
+    // Stencils of every point the patches refer to, down to the control vertices.
+    Far::StencilTableFactory::Options options;
+    options.generateIntermediateLevels = true;
+    options.generateControlVerts       = true;
+    options.generateOffsets            = true;
+    Far::TopologyRefiner const& refiner = *topology.refiner;
+    std::unique_ptr<Far::StencilTable const> pointStencils(Far::StencilTableFactory::Create(refiner, options));
+    Far::StencilTable const* localPoints = patchTable.GetLocalPointStencilTable();
+    if (pointStencils && localPoints && localPoints->GetNumStencils() > 0)
+    {
+        pointStencils.reset(
+            Far::StencilTableFactory::AppendLocalPointStencilTable(refiner, pointStencils.get(), localPoints));
+    }
+    if (!pointStencils)
+    {
+        return nullptr;
+    }
+
+    constexpr size_t blockSize = 256;
+    std::vector<SampleBlock> blocks;
+    size_t kernelBlocks[NumKernels + 1] = {};
+    for (int kernel = 0; kernel < NumKernels; ++kernel)
+    {
+        for (size_t begin = kernelOffsets[kernel]; begin < kernelOffsets[kernel + 1]; begin += blockSize)
+        {
+            blocks.push_back({ begin, std::min(begin + blockSize, kernelOffsets[kernel + 1]) });
+        }
+        kernelBlocks[kernel + 1] = blocks.size();
+    }
+    std::vector<std::vector<StencilEntry>> blockEntries(blocks.size());
+    std::vector<int> sizes(numStencils, 0);
+    for (int kernel = 0; kernel < NumKernels; ++kernel)
+    {
+        SampleBlock const* first                = blocks.data() + kernelBlocks[kernel];
+        size_t count                            = kernelBlocks[kernel + 1] - kernelBlocks[kernel];
+        std::vector<StencilEntry>* firstEntries = blockEntries.data() + kernelBlocks[kernel];
+        switch (kernel)
+        {
+        case KernelRegular:
+            composeSamples<RegularBasis>(
+                patchTable, *pointStencils, samples.data(), first, count, firstEntries, sizes.data());
+            break;
+        case KernelQuads:
+            composeSamples<FarBasis<4>>(
+                patchTable, *pointStencils, samples.data(), first, count, firstEntries, sizes.data());
+            break;
+        case KernelGregoryBasis:
+            composeSamples<FarBasis<20>>(
+                patchTable, *pointStencils, samples.data(), first, count, firstEntries, sizes.data());
+            break;
+        }
+    }
+
+    // Back into location order.
+    auto table = std::make_unique<StencilTable>();
+    table->builtSizes.swap(sizes);
+    table->builtOffsets.resize(numStencils + 1, 0);
+    std::partial_sum(table->builtSizes.begin(), table->builtSizes.end(), table->builtOffsets.begin() + 1);
+    size_t numWeights = size_t(table->builtOffsets.back());
+    table->builtOffsets.pop_back();
+    table->builtIndices.resize(numWeights);
+    table->builtWeights.resize(numWeights);
+    table->builtDuWeights.resize(numWeights);
+    table->builtDvWeights.resize(numWeights);
+    WorkParallelForN(blocks.size(), [&](size_t begin, size_t end) {
+        for (size_t block = begin; block < end; ++block)
+        {
+            StencilEntry const* entry = blockEntries[block].data();
+            for (size_t i = blocks[block].begin; i < blocks[block].end; ++i)
+            {
+                int stencil = samples[i].stencil;
+                int offset  = table->builtOffsets[stencil];
+                for (int j = 0; j < table->builtSizes[stencil]; ++j, ++entry)
+                {
+                    table->builtIndices[offset + j]   = entry->index;
+                    table->builtWeights[offset + j]   = entry->weight;
+                    table->builtDuWeights[offset + j] = entry->du;
+                    table->builtDvWeights[offset + j] = entry->dv;
+                }
+            }
+        }
+    });
+
+    table->numStencils = numStencils;
+    table->sizes       = table->builtSizes.data();
+    table->offsets     = table->builtOffsets.data();
+    table->indices     = table->builtIndices.data();
+    table->weights     = table->builtWeights.data();
+    table->duWeights   = table->builtDuWeights.data();
+    table->dvWeights   = table->builtDvWeights.data();
+    return table;
+}
+
+std::unique_ptr<StencilTable>
+createFarStencils(MyTopology const& topology, OpenSubdiv::Far::LimitStencilTableFactory::LocationArrayVec const& loc)
+{
+    using namespace OpenSubdiv;
+    Far::LimitStencilTableFactory::Options options;
+    options.generate1stDerivatives = true;
+    auto table = std::make_unique<StencilTable>();
+    table->limit.reset(
+        Far::LimitStencilTableFactory::Create(*topology.refiner, loc, nullptr, topology.patchTable.get(), options));
+    if (!table->limit)
+    {
+        return nullptr;
+    }
+    table->numStencils = table->limit->GetNumStencils();
+    table->sizes       = table->limit->GetSizes().data();
+    table->offsets     = table->limit->GetOffsets().data();
+    table->indices     = table->limit->GetControlIndices().data();
+    table->weights     = table->limit->GetWeights().data();
+    table->duWeights   = table->limit->GetDuWeights().data();
+    table->dvWeights   = table->limit->GetDvWeights().data();
+    return table;
+}
+
+// Limit stencils when the topology is refined, cage stencils otherwise (preview quality).
+// The patch kernels are opt-in until mygpBench --check-stencils has matched them against
+// Far on the meshes at hand.
+std::unique_ptr<StencilTable>
+createStencils(MyTopology const& topology, OpenSubdiv::Far::LimitStencilTableFactory::LocationArrayVec const& loc)
+{
+    if (!topology.refiner || !topology.patchTable)
+    {
+        return createCageStencils(topology, loc);
+    }
+    if (MyFurLayout::UsesPatchKernels())
+    {
+        if (std::unique_ptr<StencilTable> table = createPatchStencils(topology, loc))
+        {
+            return table;
+        }
+    }
+    return createFarStencils(topology, loc);
+}
+
+// Limit-surface (or, unrefined, control-quad) area of every ptex face, integrated with a
+// 2x2 Gauss rule.
+std::vector<float>
+limitFaceAreas(MyTopology const& topology, int nfaces, GfVec3f const* points)
+{
+    TRACE_FUNCTION();
+    using namespace OpenSubdiv;
+    float const g0   = 0.5f - 0.5f / std::sqrt(3.0f);
+    float const g1   = 0.5f + 0.5f / std::sqrt(3.0f);
+    float const s[4] = { g0, g1, g0, g1 };
+    float const t[4] = { g0, g0, g1, g1 };
+
+    Far::LimitStencilTableFactory::LocationArrayVec locations(nfaces);
+    for (int face = 0; face < nfaces; ++face)
+    {
+        locations[face].ptexIdx      = face;
+        locations[face].numLocations = 4;
+        locations[face].s            = s;
+        locations[face].t            = t;
+    }
+    std::vector<float> areas(nfaces, 0.0f);
+    std::unique_ptr<StencilTable> table = createStencils(topology, locations);
+    if (!table || table->numStencils != 4 * nfaces)
+    {
+        return areas;
+    }
+
+    int const* sizes       = table->sizes;
+    int const* offsets     = table->offsets;
+    int const* indices     = table->indices;
+    float const* duWeights = table->duWeights;
+    float const* dvWeights = table->dvWeights;
+    WorkParallelForN(nfaces, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face)
+        {
+            for (int q = 0; q < 4; ++q)
+            {
+                int stencil = int(face) * 4 + q;
+                GfVec3f du(0.0f), dv(0.0f);
+                for (int i = offsets[stencil]; i < offsets[stencil] + sizes[stencil]; ++i)
+                {
+                    du += duWeights[i] * points[indices[i]];
+                    dv += dvWeights[i] * points[indices[i]];
+                }
+                areas[face] += 0.25f * GfCross(du, dv).GetLength();
+            }
+        }
+    });
+    return areas;
+}
+
+// Spreads the guide budget over the ptex faces proportionally to area x density using
+// systematic sampling over the prefix sum of the weights: face f receives
+// floor(N * C[f + 1] / C[n] + u) - floor(N * C[f] / C[n] + u) curves, which adds up to exactly N.
+std::vector<int>
+distributeCurves(MyTopology const& topology, MyFurLayoutParams const& params, int nfaces, GfVec3f const* rest)
+{
+    VtIntArray const& faceVertexCounts = topology.faceVertexCounts;
+    std::vector<float> density(nfaces, 1.0f);
+    if (usesDensity(faceVertexCounts, params))
+    {
+        for (size_t face = 0, ptex = 0; face < faceVertexCounts.size(); ++face)
+        {
+            for (int i = 0; i < ptexFacesOf(faceVertexCounts[face]); ++i)
+            {
+                density[ptex++] = std::max(0.0f, params.density[face]);
+            }
+        }
+    }
+
+    std::vector<float> areas = limitFaceAreas(topology, nfaces, rest);
+    std::vector<double> cdf(nfaces + 1, 0.0);
+    for (int face = 0; face < nfaces; ++face)
+    {
+        cdf[face + 1] = cdf[face] + double(areas[face]) * density[face];
+    }
+    if (cdf[nfaces] <= 0.0)
+    {
+        // Degenerate (zero-area) meshes still honour the density.
+        for (int face = 0; face < nfaces; ++face)
+        {
+            cdf[face + 1] = cdf[face] + density[face];
+        }
+    }
+
+    std::vector<int> counts(nfaces, 0);
+    double total = cdf[nfaces];
+    if (total <= 0.0)
+    {
+        return counts;
+    }
+    double const n      = double(guideBudget(params));
+    double const offset = MyRandomStream(globalStream).Next();
+    WorkParallelForN(nfaces, [&](size_t begin, size_t end) {
+        for (size_t face = begin; face < end; ++face)
+        {
+            double lo    = std::floor(n * cdf[face] / total + offset);
+            double hi    = std::floor((face + 1 == size_t(nfaces) ? n : n * cdf[face + 1] / total) + offset);
+            counts[face] = int(hi - lo);
+        }
+    });
+    return counts;
+}
+} // namespace
+
+int
+MyFurLayout::GetNumPtexFaces(VtIntArray const& faceVertexCounts)
+{
+    return std::accumulate(faceVertexCounts.begin(), faceVertexCounts.end(), 0, [](int total, int nverts) {
+        return total + ptexFacesOf(nverts);
+    });
+}
+
+int
+MyFurLayout::ComputeNumCurves(VtIntArray const& faceVertexCounts, MyFurLayoutParams const& params)
+{
+    return ComputeNumGuides(faceVertexCounts, params) * (1 + std::max(0, params.childrenPerGuide));
+}
+
+int
+MyFurLayout::ComputeNumGuides(VtIntArray const& faceVertexCounts, MyFurLayoutParams const& params)
+{
+    int nfaces = GetNumPtexFaces(faceVertexCounts);
+    if (params.maxCurves <= 0)
+    {
+        return std::max(0, params.numSamplesPerFace) * nfaces;
+    }
+    if (nfaces <= 0)
+    {
+        return 0;
+    }
+    if (usesDensity(faceVertexCounts, params))
+    {
+        for (size_t face = 0; face < faceVertexCounts.size(); ++face)
+        {
+            if (params.density[face] > 0.0f && ptexFacesOf(faceVertexCounts[face]) > 0)
+            {
+                return guideBudget(params);
+            }
+        }
+        return 0;
+    }
+    return guideBudget(params);
+}
+
+bool
+MyFurLayout::UsesPatchKernels()
+{
+    static bool const usePatchKernels = TfGetEnvSetting(MYGP_FUR_STENCIL_BUILDER) == "patch";
+    return usePatchKernels;
+}
+
+double
+MyFurLayout::CompareStencilBuilders(MyTopology const& topology, int numSamplesPerFace, GfVec3f const* points)
+{
+    TRACE_FUNCTION();
+    using namespace OpenSubdiv;
+    if (!topology.refiner || !topology.patchTable || numSamplesPerFace <= 0)
+    {
+        return -1.0;
+    }
+
+    // Locations drawn the way Create draws them.
+    int nfaces = GetNumPtexFaces(topology.faceVertexCounts);
+    std::vector<float> s(size_t(nfaces) * numSamplesPerFace), t(s.size());
+    Far::LimitStencilTableFactory::LocationArrayVec locations(nfaces);
+    for (int face = 0; face < nfaces; ++face)
+    {
+        MyRandomStream random(face);
+        size_t first = size_t(face) * numSamplesPerFace;
+        for (int i = 0; i < numSamplesPerFace; ++i)
+        {
+            s[first + i] = random.Next();
+            t[first + i] = random.Next();
+        }
+        locations[face].ptexIdx      = face;
+        locations[face].numLocations = numSamplesPerFace;
+        locations[face].s            = s.data() + first;
+        locations[face].t            = t.data() + first;
+    }
+    std::unique_ptr<StencilTable> kernels   = createPatchStencils(topology, locations);
+    std::unique_ptr<StencilTable> reference = createFarStencils(topology, locations);
+    if (!kernels || !reference || kernels->numStencils != reference->numStencils)
+    {
+        return -1.0;
+    }
+
+    // The tables may order or merge their control vertices differently, so they are
+    // compared by what they evaluate to.
+    auto difference = [&](float const* StencilTable::*weights, int stencil) {
+        GfVec3d sum(0.0);
+        for (StencilTable const* table : { kernels.get(), reference.get() })
+        {
+            double sign = table == kernels.get() ? 1.0 : -1.0;
+            for (int i = table->offsets[stencil]; i < table->offsets[stencil] + table->sizes[stencil]; ++i)
+            {
+                sum += sign * double((table->*weights)[i]) * GfVec3d(points[table->indices[i]]);
+            }
+        }
+        return sum.GetLength();
+    };
+    double error = 0.0;
+    for (int stencil = 0; stencil < reference->numStencils; ++stencil)
+    {
+        error = std::max({ error,
+                           difference(&StencilTable::weights, stencil),
+                           difference(&StencilTable::duWeights, stencil),
+                           difference(&StencilTable::dvWeights, stencil) });
+    }
+    GfRange3d bounds;
+    for (int i = 0; i < topology.numVertices; ++i)
+    {
+        bounds.UnionWith(GfVec3d(points[i]));
+    }
+    double size = bounds.IsEmpty() ? 0.0 : bounds.GetSize().GetLength();
+    return size > 0.0 ? error / size : error;
+}
+
+MyFurLayoutSharedPtr
+MyFurLayout::Create(MyTopologySharedPtr const& topology, MyFurLayoutParams const& params, GfVec3f const* rest)
+{
+    TRACE_FUNCTION();
+    using namespace OpenSubdiv;
+
+    auto layout       = std::shared_ptr<MyFurLayout>(new MyFurLayout);
+    layout->_topology = topology;
+    layout->_params   = params;
+
+    int nfaces = GetNumPtexFaces(topology->faceVertexCounts);
+    std::vector<int> counts;
+    if (params.maxCurves > 0)
+    {
+        counts = distributeCurves(*topology, params, nfaces, rest);
+    }
+    else
+    {
+        counts.assign(nfaces, std::max(0, params.numSamplesPerFace));
+    }
+    layout->_faceOffsets.resize(nfaces + 1, 0);
+    std::partial_sum(counts.begin(), counts.end(), layout->_faceOffsets.begin() + 1);
+    int numCurves = layout->GetNumGuides();
+    if (numCurves == 0)
+    {
+        return layout;
+    }
+
+    // (s,t) only depend on (face, sample), so the patch lookup and basis evaluation
+    // are baked into the stencils once per topology and layout.
+    std::vector<int> const& offsets = layout->_faceOffsets;
+    std::vector<float> s(numCurves), t(numCurves);
+    Far::LimitStencilTableFactory::LocationArrayVec locations(nfaces);
+    WorkParallelForN(nfaces, [&](size_t begin, size_t end) {
+        for (int face = int(begin); face < int(end); ++face)
+        {
+            MyRandomStream random(face);
+            for (int count = offsets[face]; count < offsets[face + 1]; ++count)
+            {
+                s[count] = random.Next();
+                t[count] = random.Next();
+            }
+            auto& location        = locations[face];
+            location.ptexIdx      = face;
+            location.numLocations = counts[face];
+            location.s            = s.data() + offsets[face];
+            location.t            = t.data() + offsets[face];
+        }
+    });
+
+    std::unique_ptr<StencilTable> stencils = createStencils(*topology, locations);
+    if (stencils && stencils->numStencils == numCurves)
+    {
+        TRACE_SCOPE("MyFurStencils");
+        layout->_stencils = std::make_unique<MyFurStencils const>(stencils->numStencils,
+                                                                  stencils->sizes,
+                                                                  stencils->offsets,
+                                                                  stencils->indices,
+                                                                  stencils->weights,
+                                                                  stencils->duWeights,
+                                                                  stencils->dvWeights);
+    }
+    if (layout->_stencils && params.childrenPerGuide > 0)
+    {
+        // Neighbours are found from the guide roots on the rest pose and kept, like the areas.
+        std::vector<GfVec3f> guides(2 * size_t(numCurves));
+        layout->_stencils->EvaluateCurves(rest, 0.0f, 0, layout->_stencils->GetNumSlices(), guides.data());
+        std::vector<GfVec3f> roots(numCurves);
+        for (int i = 0; i < numCurves; ++i)
+        {
+            roots[i] = guides[2 * i];
+        }
+        layout->_children = MyFurChildren::Create(roots.data(), numCurves, params.childrenPerGuide);
+    }
+    TF_DEBUG(MYGP_FUR_LAYOUT)
+        .Msg("Built fur layout: %d guides over %d ptex faces, %d children per guide, %zu stencil bytes\n",
+             numCurves,
+             nfaces,
+             params.childrenPerGuide,
+             layout->_stencils ? layout->_stencils->GetMemoryUsage() : size_t(0));
+    return layout;
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "gp_furChildren.h"
+#include "gp_furStencils.h"
+#include "gp_topologyCache.h"
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/base/vt/types.h>
+#include <pxr/pxr.h>
+
+#include <memory>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Parameters that decide where hairs are rooted on the source mesh.
+struct MyFurLayoutParams
+{
+    int numSamplesPerFace = 1;
+    // Global curve budget. When positive, curves are spread by limit-surface area x density
+    // instead of numSamplesPerFace per face. With children, it covers guides and children
+    // together: maxCurves / (1 + childrenPerGuide) guides are placed.
+    int maxCurves = 0;
+    // Per-face weights from the source mesh's uniform density primvar, empty when unused.
+    VtFloatArray density;
+    // When positive, the curves above become guides and each one gets this many
+    // interpolated children.
+    int childrenPerGuide = 0;
+    // Pose the area weights and child neighbours are computed on, so that the roots do not
+    // depend on the frame a layout happens to be built at. Only set when one of them is used.
+    VtVec3fArray rest;
+
+    bool operator==(MyFurLayoutParams const& other) const
+    {
+        return numSamplesPerFace == other.numSamplesPerFace && maxCurves == other.maxCurves &&
+               density == other.density && childrenPerGuide == other.childrenPerGuide && rest == other.rest;
+    }
+    bool operator!=(MyFurLayoutParams const& other) const { return !(*this == other); }
+};
+
+// Root locations of every curve, grouped by ptex face, compiled into limit stencils (or
+// bilinear control-cage stencils when the topology was built without refinement).
+// Depends only on the topology and the layout parameters (including the rest pose), so it
+// is reused across deforming frames.
+class MyFurLayout
+{
+public:
+    // rest holds topology->numVertices points, normally params.rest.
+    static std::shared_ptr<MyFurLayout const> Create(MyTopologySharedPtr const& topology,
+                                                     MyFurLayoutParams const& params,
+                                                     GfVec3f const* rest);
+
+    // Number of curves a layout built from these inputs will contain, without building it.
+    static int ComputeNumCurves(VtIntArray const& faceVertexCounts, MyFurLayoutParams const& params);
+    static int ComputeNumGuides(VtIntArray const& faceVertexCounts, MyFurLayoutParams const& params);
+    static int GetNumPtexFaces(VtIntArray const& faceVertexCounts);
+    // Whether refined layouts try the per-patch-type kernels for their limit stencils
+    // (MYGP_FUR_STENCIL_BUILDER=patch) before Far::LimitStencilTableFactory.
+    static bool UsesPatchKernels();
+
+    // Largest difference between the limit stencils of the per-patch-type kernels and of
+    // Far::LimitStencilTableFactory at numSamplesPerFace random locations per ptex face,
+    // applied to points (topology.numVertices of them): over position and both derivatives,
+    // relative to the diagonal of their bounding box. Negative when the topology is not
+    // refined or the kernels decline it, in which case Far is used anyway.
+    static double CompareStencilBuilders(MyTopology const& topology, int numSamplesPerFace, GfVec3f const* points);
+
+    MyTopologySharedPtr const& GetTopology() const { return _topology; }
+    MyFurLayoutParams const& GetParams() const { return _params; }
+    // Guides come first, followed by their children.
+    int GetNumCurves() const { return GetNumGuides() + (_children ? int(_children->GetNumChildren()) : 0); }
+    int GetNumGuides() const { return _faceOffsets.empty() ? 0 : _faceOffsets.back(); }
+    // Guides of ptex face f are [offsets[f], offsets[f + 1]).
+    std::vector<int> const& GetFaceOffsets() const { return _faceOffsets; }
+    // Null when the layout has no curves.
+    MyFurStencils const* GetStencils() const { return _stencils.get(); }
+    // Null unless childrenPerGuide is positive.
+    MyFurChildren const* GetChildren() const { return _children.get(); }
+
+private:
+    MyFurLayout() = default;
+
+    MyTopologySharedPtr _topology;
+    MyFurLayoutParams _params;
+    std::vector<int> _faceOffsets;
+    std::unique_ptr<MyFurStencils const> _stencils;
+    std::unique_ptr<MyFurChildren const> _children;
+};
+using MyFurLayoutSharedPtr = std::shared_ptr<MyFurLayout const>;
+
+PXR_NAMESPACE_CLOSE_SCOPE
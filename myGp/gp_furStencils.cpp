@@ -0,0 +1,416 @@
+#include "gp_furStencils.h"
+
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/tf/stringUtils.h"
+#include "pxr/base/work/loops.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MYGP_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define MYGP_TARGET_AVX2
+#define MYGP_TARGET_AVX512
+#else
+#define MYGP_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define MYGP_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+#endif
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_ENV_SETTING(MYGP_FUR_SIMD, "auto", "Fur evaluation kernel: auto, avx512, avx2 or scalar");
+
+namespace {
+constexpr int W = MyFurStencils::SliceWidth;
+
+// Same guard as GfVec3f::Normalize.
+constexpr float minNormalLength = 1e-10f;
+
+struct Kernel
+{
+    int numStencils;
+    uint32_t const* columnOffsets;
+    int const* indices;
+    float const *weights, *duWeights, *dvWeights;
+    float const* points;
+    float length;
+    GfVec3f* out;
+    int outFirst; // stencil stored at out[0]
+
+    void Store(size_t slice, int laneBegin, int laneCount, float const* p[3], float const* tip[3]) const
+    {
+        int first    = int(slice) * W + laneBegin;
+        int count    = std::min(laneCount, numStencils - first);
+        GfVec3f* dst = out + 2 * size_t(first - outFirst);
+        for (int lane = 0; lane < count; ++lane)
+        {
+            dst[2 * lane]     = GfVec3f(p[0][lane], p[1][lane], p[2][lane]);
+            dst[2 * lane + 1] = GfVec3f(tip[0][lane], tip[1][lane], tip[2][lane]);
+        }
+    }
+};
+
+void
+evaluateScalar(Kernel const& k, size_t sliceBegin, size_t sliceEnd)
+{
+    for (size_t slice = sliceBegin; slice < sliceEnd; ++slice)
+    {
+        float px[W] = {}, py[W] = {}, pz[W] = {};
+        float ux[W] = {}, uy[W] = {}, uz[W] = {};
+        float vx[W] = {}, vy[W] = {}, vz[W] = {};
+        for (uint32_t column = k.columnOffsets[slice]; column < k.columnOffsets[slice + 1]; ++column)
+        {
+            size_t base = size_t(column) * W;
+            for (int lane = 0; lane < W; ++lane)
+            {
+                float const* src = k.points + 3 * size_t(k.indices[base + lane]);
+                float w = k.weights[base + lane], du = k.duWeights[base + lane], dv = k.dvWeights[base + lane];
+                px[lane] += w * src[0];
+                py[lane] += w * src[1];
+                pz[lane] += w * src[2];
+                ux[lane] += du * src[0];
+                uy[lane] += du * src[1];
+                uz[lane] += du * src[2];
+                vx[lane] += dv * src[0];
+                vy[lane] += dv * src[1];
+                vz[lane] += dv * src[2];
+            }
+        }
+        float tx[W], ty[W], tz[W];
+        for (int lane = 0; lane < W; ++lane)
+        {
+            float nx    = uy[lane] * vz[lane] - uz[lane] * vy[lane];
+            float ny    = uz[lane] * vx[lane] - ux[lane] * vz[lane];
+            float nz    = ux[lane] * vy[lane] - uy[lane] * vx[lane];
+            float scale = k.length / std::max(std::sqrt(nx * nx + ny * ny + nz * nz), minNormalLength);
+            tx[lane]    = px[lane] + scale * nx;
+            ty[lane]    = py[lane] + scale * ny;
+            tz[lane]    = pz[lane] + scale * nz;
+        }
+        float const* p[3]   = { px, py, pz };
+        float const* tip[3] = { tx, ty, tz };
+        k.Store(slice, 0, W, p, tip);
+    }
+}
+
+#if MYGP_X86
+MYGP_TARGET_AVX2 void
+evaluateAvx2(Kernel const& k, size_t sliceBegin, size_t sliceEnd)
+{
+    __m256 const eps    = _mm256_set1_ps(minNormalLength);
+    __m256 const length = _mm256_set1_ps(k.length);
+    for (size_t slice = sliceBegin; slice < sliceEnd; ++slice)
+    {
+        for (int half = 0; half < W; half += 8)
+        {
+            __m256 px = _mm256_setzero_ps(), py = _mm256_setzero_ps(), pz = _mm256_setzero_ps();
+            __m256 ux = _mm256_setzero_ps(), uy = _mm256_setzero_ps(), uz = _mm256_setzero_ps();
+            __m256 vx = _mm256_setzero_ps(), vy = _mm256_setzero_ps(), vz = _mm256_setzero_ps();
+            for (uint32_t column = k.columnOffsets[slice]; column < k.columnOffsets[slice + 1]; ++column)
+            {
+                size_t base  = size_t(column) * W + half;
+                __m256i idx  = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(k.indices + base));
+                idx          = _mm256_add_epi32(idx, _mm256_add_epi32(idx, idx));
+                __m256 x     = _mm256_i32gather_ps(k.points, idx, 4);
+                __m256 y     = _mm256_i32gather_ps(k.points + 1, idx, 4);
+                __m256 z     = _mm256_i32gather_ps(k.points + 2, idx, 4);
+                __m256 w     = _mm256_loadu_ps(k.weights + base);
+                __m256 du    = _mm256_loadu_ps(k.duWeights + base);
+                __m256 dv    = _mm256_loadu_ps(k.dvWeights + base);
+                px           = _mm256_fmadd_ps(w, x, px);
+                py           = _mm256_fmadd_ps(w, y, py);
+                pz           = _mm256_fmadd_ps(w, z, pz);
+                ux           = _mm256_fmadd_ps(du, x, ux);
+                uy           = _mm256_fmadd_ps(du, y, uy);
+                uz           = _mm256_fmadd_ps(du, z, uz);
+                vx           = _mm256_fmadd_ps(dv, x, vx);
+                vy           = _mm256_fmadd_ps(dv, y, vy);
+                vz           = _mm256_fmadd_ps(dv, z, vz);
+            }
+            __m256 nx    = _mm256_fmsub_ps(uy, vz, _mm256_mul_ps(uz, vy));
+            __m256 ny    = _mm256_fmsub_ps(uz, vx, _mm256_mul_ps(ux, vz));
+            __m256 nz    = _mm256_fmsub_ps(ux, vy, _mm256_mul_ps(uy, vx));
+            __m256 len   = _mm256_sqrt_ps(_mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz))));
+            __m256 scale = _mm256_div_ps(length, _mm256_max_ps(len, eps));
+
+            alignas(32) float p[3][8], tip[3][8];
+            _mm256_store_ps(p[0], px);
+            _mm256_store_ps(p[1], py);
+            _mm256_store_ps(p[2], pz);
+            _mm256_store_ps(tip[0], _mm256_fmadd_ps(scale, nx, px));
+            _mm256_store_ps(tip[1], _mm256_fmadd_ps(scale, ny, py));
+            _mm256_store_ps(tip[2], _mm256_fmadd_ps(scale, nz, pz));
+            float const* pp[3] = { p[0], p[1], p[2] };
+            float const* tp[3] = { tip[0], tip[1], tip[2] };
+            k.Store(slice, half, 8, pp, tp);
+        }
+    }
+}
+
+MYGP_TARGET_AVX512 void
+evaluateAvx512(Kernel const& k, size_t sliceBegin, size_t sliceEnd)
+{
+    __m512 const eps    = _mm512_set1_ps(minNormalLength);
+    __m512 const length = _mm512_set1_ps(k.length);
+    for (size_t slice = sliceBegin; slice < sliceEnd; ++slice)
+    {
+        __m512 px = _mm512_setzero_ps(), py = _mm512_setzero_ps(), pz = _mm512_setzero_ps();
+        __m512 ux = _mm512_setzero_ps(), uy = _mm512_setzero_ps(), uz = _mm512_setzero_ps();
+        __m512 vx = _mm512_setzero_ps(), vy = _mm512_setzero_ps(), vz = _mm512_setzero_ps();
+        for (uint32_t column = k.columnOffsets[slice]; column < k.columnOffsets[slice + 1]; ++column)
+        {
+            size_t base = size_t(column) * W;
+            __m512i idx = _mm512_loadu_si512(k.indices + base);
+            idx         = _mm512_add_epi32(idx, _mm512_add_epi32(idx, idx));
+            __m512 x    = _mm512_i32gather_ps(idx, k.points, 4);
+            __m512 y    = _mm512_i32gather_ps(idx, k.points + 1, 4);
+            __m512 z    = _mm512_i32gather_ps(idx, k.points + 2, 4);
+            __m512 w    = _mm512_loadu_ps(k.weights + base);
+            __m512 du   = _mm512_loadu_ps(k.duWeights + base);
+            __m512 dv   = _mm512_loadu_ps(k.dvWeights + base);
+            px          = _mm512_fmadd_ps(w, x, px);
+            py          = _mm512_fmadd_ps(w, y, py);
+            pz          = _mm512_fmadd_ps(w, z, pz);
+            ux          = _mm512_fmadd_ps(du, x, ux);
+            uy          = _mm512_fmadd_ps(du, y, uy);
+            uz          = _mm512_fmadd_ps(du, z, uz);
+            vx          = _mm512_fmadd_ps(dv, x, vx);
+            vy          = _mm512_fmadd_ps(dv, y, vy);
+            vz          = _mm512_fmadd_ps(dv, z, vz);
+        }
+        __m512 nx    = _mm512_fmsub_ps(uy, vz, _mm512_mul_ps(uz, vy));
+        __m512 ny    = _mm512_fmsub_ps(uz, vx, _mm512_mul_ps(ux, vz));
+        __m512 nz    = _mm512_fmsub_ps(ux, vy, _mm512_mul_ps(uy, vx));
+        __m512 len   = _mm512_sqrt_ps(_mm512_fmadd_ps(nx, nx, _mm512_fmadd_ps(ny, ny, _mm512_mul_ps(nz, nz))));
+        __m512 scale = _mm512_div_ps(length, _mm512_max_ps(len, eps));
+
+        alignas(64) float p[3][W], tip[3][W];
+        _mm512_store_ps(p[0], px);
+        _mm512_store_ps(p[1], py);
+        _mm512_store_ps(p[2], pz);
+        _mm512_store_ps(tip[0], _mm512_fmadd_ps(scale, nx, px));
+        _mm512_store_ps(tip[1], _mm512_fmadd_ps(scale, ny, py));
+        _mm512_store_ps(tip[2], _mm512_fmadd_ps(scale, nz, pz));
+        float const* pp[3] = { p[0], p[1], p[2] };
+        float const* tp[3] = { tip[0], tip[1], tip[2] };
+        k.Store(slice, 0, W, pp, tp);
+    }
+}
+
+bool
+cpuSupports(MyFurStencils::Isa isa)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool fma     = (info[2] & (1 << 12)) != 0;
+    if (!osxsave)
+    {
+        return false;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (isa == MyFurStencils::Isa::Avx2)
+    {
+        return fma && (info[1] & (1 << 5)) && (xcr0 & 0x6) == 0x6;
+    }
+    return (info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6;
+#else
+    __builtin_cpu_init();
+    if (isa == MyFurStencils::Isa::Avx2)
+    {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return __builtin_cpu_supports("avx512f");
+#endif
+}
+#endif
+
+MyFurStencils::Isa
+detectIsa()
+{
+    std::string requested = TfStringToLower(TfGetEnvSetting(MYGP_FUR_SIMD));
+    if (requested == "scalar")
+    {
+        return MyFurStencils::Isa::Scalar;
+    }
+#if MYGP_X86
+    if (requested != "avx2" && cpuSupports(MyFurStencils::Isa::Avx512))
+    {
+        return MyFurStencils::Isa::Avx512;
+    }
+    if (cpuSupports(MyFurStencils::Isa::Avx2))
+    {
+        return MyFurStencils::Isa::Avx2;
+    }
+#endif
+    return MyFurStencils::Isa::Scalar;
+}
+
+void
+evaluate(MyFurStencils::Isa isa, Kernel const& k, size_t sliceBegin, size_t sliceEnd)
+{
+    switch (isa)
+    {
+#if MYGP_X86
+    case MyFurStencils::Isa::Avx512:
+        evaluateAvx512(k, sliceBegin, sliceEnd);
+        return;
+    case MyFurStencils::Isa::Avx2:
+        evaluateAvx2(k, sliceBegin, sliceEnd);
+        return;
+#endif
+    default:
+        evaluateScalar(k, sliceBegin, sliceEnd);
+        return;
+    }
+}
+} // namespace
+
+MyFurStencils::MyFurStencils(int numStencils,
+                             int const* sizes,
+                             int const* offsets,
+                             int const* indices,
+                             float const* weights,
+                             float const* duWeights,
+                             float const* dvWeights)
+    : _numStencils(numStencils)
+{
+    size_t numSlices = (size_t(numStencils) + W - 1) / W;
+    _columnOffsets.resize(numSlices + 1, 0);
+    for (size_t slice = 0; slice < numSlices; ++slice)
+    {
+        int first = int(slice) * W;
+        int last  = std::min(first + W, numStencils);
+        int width = *std::max_element(sizes + first, sizes + last);
+        _columnOffsets[slice + 1] = _columnOffsets[slice] + uint32_t(width);
+    }
+
+    // Padding lanes point at CV 0 with zero weight, so the kernels never branch on stencil size.
+    size_t numEntries = size_t(_columnOffsets.back()) * W;
+    _indices.assign(numEntries, 0);
+    _weights.assign(numEntries, 0.0f);
+    _duWeights.assign(numEntries, 0.0f);
+    _dvWeights.assign(numEntries, 0.0f);
+    WorkParallelForN(numSlices, [&](size_t begin, size_t end) {
+        for (size_t slice = begin; slice < end; ++slice)
+        {
+            for (int lane = 0; lane < W && int(slice) * W + lane < numStencils; ++lane)
+            {
+                int stencil = int(slice) * W + lane;
+                for (int i = 0; i < sizes[stencil]; ++i)
+                {
+                    size_t dst     = (size_t(_columnOffsets[slice]) + i) * W + lane;
+                    size_t src     = size_t(offsets[stencil]) + i;
+                    _indices[dst]   = indices[src];
+                    _weights[dst]   = weights[src];
+                    _duWeights[dst] = duWeights[src];
+                    _dvWeights[dst] = dvWeights[src];
+                }
+            }
+        }
+    });
+}
+
+size_t
+MyFurStencils::GetMemoryUsage() const
+{
+    return _columnOffsets.size() * sizeof(uint32_t) + _indices.size() * sizeof(int) +
+           3 * _weights.size() * sizeof(float);
+}
+
+void
+MyFurStencils::EvaluateCurves(GfVec3f const* points,
+                              float length,
+                              size_t sliceBegin,
+                              size_t sliceEnd,
+                              GfVec3f* out,
+                              int outFirstStencil) const
+{
+    EvaluateCurves(1, &points, &length, sliceBegin, sliceEnd, &out, outFirstStencil);
+}
+
+void
+MyFurStencils::EvaluateCurves(size_t numTimes,
+                              GfVec3f const* const* points,
+                              float const* lengths,
+                              size_t sliceBegin,
+                              size_t sliceEnd,
+                              GfVec3f* const* outs,
+                              int outFirstStencil) const
+{
+    static Isa const isa = GetIsa();
+
+    Kernel k;
+    k.numStencils   = _numStencils;
+    k.columnOffsets = _columnOffsets.data();
+    k.indices       = _indices.data();
+    k.weights       = _weights.data();
+    k.duWeights     = _duWeights.data();
+    k.dvWeights     = _dvWeights.data();
+    k.outFirst      = outFirstStencil;
+    if (numTimes == 1)
+    {
+        k.points = reinterpret_cast<float const*>(points[0]);
+        k.length = lengths[0];
+        k.out    = outs[0];
+        evaluate(isa, k, sliceBegin, sliceEnd);
+        return;
+    }
+    // Slice-major, so the weights of a slice are read from memory once and stay in
+    // cache for every time sample.
+    for (size_t slice = sliceBegin; slice < sliceEnd; ++slice)
+    {
+        for (size_t time = 0; time < numTimes; ++time)
+        {
+            k.points = reinterpret_cast<float const*>(points[time]);
+            k.length = lengths[time];
+            k.out    = outs[time];
+            evaluate(isa, k, slice, slice + 1);
+        }
+    }
+}
+
+void
+MyFurStencils::AppendControlVertices(int stencil, std::vector<int>* indices) const
+{
+    size_t slice = size_t(stencil) / W;
+    int lane     = stencil % W;
+    for (uint32_t column = _columnOffsets[slice]; column < _columnOffsets[slice + 1]; ++column)
+    {
+        size_t i = size_t(column) * W + lane;
+        // Skips the padding of stencils shorter than their slice.
+        if (_weights[i] != 0.0f || _duWeights[i] != 0.0f || _dvWeights[i] != 0.0f)
+        {
+            indices->push_back(_indices[i]);
+        }
+    }
+}
+
+MyFurStencils::Isa
+MyFurStencils::GetIsa()
+{
+    static Isa const isa = detectIsa();
+    return isa;
+}
+
+char const*
+MyFurStencils::GetIsaName(Isa isa)
+{
+    switch (isa)
+    {
+    case Isa::Avx512:
+        return "avx512";
+    case Isa::Avx2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
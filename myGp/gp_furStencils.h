@@ -0,0 +1,74 @@
+#pragma once
+
+#include <pxr/base/gf/vec3f.h>
+#include <pxr/pxr.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Limit stencils (position and both derivatives) repacked into a sliced-ELL layout:
+// stencils are grouped into slices of SliceWidth lanes, and every slice is padded to its
+// longest stencil so that one column of a slice maps onto one SIMD register.
+// EvaluateCurves runs the weighted CV accumulation and the cross/normalize/offset that
+// builds the curve tips on whole slices, using AVX-512, AVX2 or a scalar fallback picked
+// at runtime (MYGP_FUR_SIMD=auto|avx512|avx2|scalar overrides the choice).
+class MyFurStencils
+{
+public:
+    static constexpr int SliceWidth = 16;
+
+    enum class Isa
+    {
+        Scalar,
+        Avx2,
+        Avx512
+    };
+
+    // Builds the slices from a CSR stencil table (e.g. Far::LimitStencilTable arrays).
+    MyFurStencils(int numStencils,
+                  int const* sizes,
+                  int const* offsets,
+                  int const* indices,
+                  float const* weights,
+                  float const* duWeights,
+                  float const* dvWeights);
+
+    int GetNumStencils() const { return _numStencils; }
+    size_t GetNumSlices() const { return _columnOffsets.size() - 1; }
+    size_t GetMemoryUsage() const;
+
+    // Writes a (root, tip) pair per stencil of slices [sliceBegin, sliceEnd) into out,
+    // indexed by stencil - outFirstStencil. Tips are offset by length along the normalized du x dv.
+    void EvaluateCurves(GfVec3f const* points,
+                        float length,
+                        size_t sliceBegin,
+                        size_t sliceEnd,
+                        GfVec3f* out,
+                        int outFirstStencil = 0) const;
+    // Same for several time samples at once (motion blur): points[i], lengths[i] and outs[i]
+    // belong to sample i.
+    void EvaluateCurves(size_t numTimes,
+                        GfVec3f const* const* points,
+                        float const* lengths,
+                        size_t sliceBegin,
+                        size_t sliceEnd,
+                        GfVec3f* const* outs,
+                        int outFirstStencil = 0) const;
+
+    // Appends the control vertices a stencil reads from.
+    void AppendControlVertices(int stencil, std::vector<int>* indices) const;
+
+    static Isa GetIsa();
+    static char const* GetIsaName(Isa isa);
+
+private:
+    int _numStencils = 0;
+    std::vector<uint32_t> _columnOffsets; // per slice, into the column arrays
+    std::vector<int> _indices;            // [column][lane]
+    std::vector<float> _weights, _duWeights, _dvWeights;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -1,4 +1,5 @@
 #include "gp_mesh.h"
+#include "gp_stats.h"
 
 #include "pxr/imaging/hd/meshSchema.h"
 #include "pxr/imaging/hd/meshTopologySchema.h"
@@ -6,19 +7,125 @@
 #include "pxr/imaging/hd/retainedDataSource.h"
 #include "pxr/imaging/hd/tokens.h"
 #include "pxr/imaging/hd/xformSchema.h"
+#include "pxr/base/tf/stringUtils.h"
+#include "pxr/base/trace/trace.h"
+#include "pxr/base/work/loops.h"
 
+#include <cmath>
 #include <iostream>
+#include <mutex>
 
 PXR_NAMESPACE_USING_DIRECTIVE
 
 TF_DEFINE_PRIVATE_TOKENS(_tokens,
-                         (size)  //
-                         (param) //
-                         (pc)    //
+                         (size)     //
+                         (param)    //
+                         (pc)       //
+                         (tileSize) //
+                         (stats)    //
 );
 
+namespace {
+//------------------------------------------------------------------------------
+// Faces of a width x height grid of quads, one row of faces per task.
+void
+buildGridTopology(int width, int height, VtIntArray* faceVertexCounts, VtIntArray* faceVertexIndices)
+{
+    TRACE_FUNCTION();
+    int stride = width + 1;
+    faceVertexCounts->assign(size_t(width) * height, 4);
+    faceVertexIndices->resize(4 * size_t(width) * height);
+    int* indices = faceVertexIndices->data();
+    WorkParallelForN(height, [&](size_t begin, size_t end) {
+        for (int z = int(begin) + 1; z <= int(end); ++z)
+        {
+            for (int x = 1; x <= width; ++x)
+            {
+                int index = z * stride + x;
+                int* face = indices + 4 * (size_t(z - 1) * width + (x - 1));
+                face[0]   = index - stride;
+                face[1]   = index - stride - 1;
+                face[2]   = index - 1;
+                face[3]   = index;
+            }
+        }
+    });
+}
+
+// Height field of one tile of the grid, evaluated on first use and kept until the procedural
+// replaces it.
+class _GridPointsDataSource : public HdVec3fArrayDataSource
+{
+public:
+    HD_DECLARE_DATASOURCE(_GridPointsDataSource);
+
+    bool GetContributingSampleTimesForInterval(Time startTime, Time endTime, std::vector<Time>* outSampleTimes) override
+    {
+        return false;
+    }
+    VtValue GetValue(Time shutterOffset) override { return VtValue(GetTypedValue(shutterOffset)); }
+    VtVec3fArray GetTypedValue(Time shutterOffset) override
+    {
+        std::call_once(_computed, [this]() { _points = _Compute(); });
+        return _points;
+    }
+
+private:
+    _GridPointsDataSource(MyProceduralMesh::GridRegion const& region, MyProceduralStatsSharedPtr const& stats)
+        : _region(region)
+        , _stats(stats)
+    {
+    }
+    VtVec3fArray _Compute() const
+    {
+        TRACE_FUNCTION();
+        MyScopedEvaluationTimer timer(_stats.get());
+        // sin(x + param) * cos(z + param) is separable, so one table per axis replaces the
+        // per-point trig and the rows reduce to a multiply.
+        MyProceduralMesh::GridRegion const& r = _region;
+
+        int stride = r.width + 1, rows = r.height + 1;
+        std::vector<float> sinX(stride), cosZ(rows);
+        for (int i = 0; i < stride; ++i)
+        {
+            sinX[i] = std::sin(r.x0 + i + r.param);
+        }
+        for (int i = 0; i < rows; ++i)
+        {
+            cosZ[i] = std::cos(r.z0 + i + r.param);
+        }
+        VtVec3fArray points(size_t(stride) * rows);
+        GfVec3f* out = points.data();
+        WorkParallelForN(rows, [&](size_t begin, size_t end) {
+            for (size_t z = begin; z < end; ++z)
+            {
+                GfVec3f* row = out + z * stride;
+                float c      = cosZ[z];
+                float pz     = float(r.z0 + int(z));
+                for (int x = 0; x < stride; ++x)
+                {
+                    row[x] = GfVec3f(float(r.x0 + x), sinX[x] * c, pz);
+                }
+            }
+        });
+        if (_stats)
+        {
+            _stats->AddPointsEmitted(points.size());
+            _stats->AddBytesAllocated(points.size() * sizeof(GfVec3f));
+        }
+        return points;
+    }
+
+    MyProceduralMesh::GridRegion _region;
+    MyProceduralStatsSharedPtr _stats;
+    std::once_flag _computed;
+    VtVec3fArray _points;
+};
+} // namespace
+
 MyProceduralMesh::MyProceduralMesh(const SdfPath& proceduralPrimPath)
     : HdGpGenerativeProcedural(proceduralPrimPath)
+    , _stats(std::make_shared<MyProceduralStats>("MyProceduralMesh"))
 {
 }
 
@@ -42,30 +149,134 @@ MyProceduralMesh::Update(const HdSceneIndexBaseRefPtr& inputScene,
                          const DependencyMap& dirtiedDependencies,
                          HdSceneIndexObserver::DirtiedPrimEntries* outputDirtiedPrims)
 {
+    TRACE_FUNCTION();
     ChildPrimTypeMap result;
     HdSceneIndexPrim myPrim   = inputScene->GetPrim(_GetProceduralPrimPath());
     HdPrimvarsSchema primvars = HdPrimvarsSchema::GetFromParent(myPrim.dataSource);
 
     // parameter
+    float size  = _size;
+    float param = _param;
     if (HdSampledDataSourceHandle sizeDs = primvars.GetPrimvar(_tokens->size).GetPrimvarValue())
     {
-        _size = std::max(1.0f, sizeDs->GetValue(0.0f).GetWithDefault(_size));
+        size = std::max(1.0f, sizeDs->GetValue(0.0f).GetWithDefault(_size));
     }
     if (HdSampledDataSourceHandle paramDs = primvars.GetPrimvar(_tokens->param).GetPrimvarValue())
     {
-        _param = paramDs->GetValue(0.0f).GetWithDefault(_param);
+        param = paramDs->GetValue(0.0f).GetWithDefault(_param);
+    }
+    int tileSize = 0;
+    if (HdSampledDataSourceHandle tileSizeDs = primvars.GetPrimvar(_tokens->tileSize).GetPrimvarValue())
+    {
+        VtValue v = tileSizeDs->GetValue(0.0f);
+        tileSize  = v.IsHolding<int>() ? v.UncheckedGet<int>() : int(v.GetWithDefault<float>(0.0f));
     }
+    _size  = size;
+    _param = param;
+
+    // The grid only follows the integer part of size. Without tiling the whole grid is a single
+    // tile named pc, as before. Tiles duplicate their shared edge vertices so each one is a
+    // self-contained mesh Hydra can sync on its own. The grid is centred by the xforms, so a
+    // new size only moves the tiles it does not reshape.
+    int gridSize = int(_size);
+    int tile     = tileSize > 0 ? std::min(tileSize, gridSize) : gridSize;
+    int numTiles = (gridSize + tile - 1) / tile;
+    float offset = float(gridSize / 2) + 0.5f;
+
+    SdfPath path = _GetProceduralPrimPath();
+    std::map<SdfPath, _Tile> tiles;
+    std::map<std::pair<int, int>, _Tile> topologies;
+    for (int tz = 0; tz < numTiles; ++tz)
+    {
+        for (int tx = 0; tx < numTiles; ++tx)
+        {
+            GridRegion region;
+            region.x0     = tx * tile;
+            region.z0     = tz * tile;
+            region.width  = std::min(tile, gridSize - region.x0);
+            region.height = std::min(tile, gridSize - region.z0);
+            region.param  = _param;
+
+            SdfPath childPath = tileSize > 0
+                                    ? path.AppendChild(TfToken(TfStringPrintf("tile_%d_%d", tx, tz)))
+                                    : path.AppendChild(_tokens->pc); // Hydra Rprim BO͉ł
+            result[childPath] = HdPrimTypeTokens->mesh;
+
+            // A newly added child is pulled in full anyway.
+            bool isNew    = previousResult.find(childPath) == previousResult.end();
+            auto previous = _tiles.find(childPath);
+            bool moved    = previous != _tiles.end() && previous->second.offset != offset;
+            if (previous != _tiles.end() && previous->second.region == region)
+            {
+                // Same vertices; growing or shrinking the grid at most moves the tile.
+                tiles[childPath]        = previous->second;
+                tiles[childPath].offset = offset;
+                if (outputDirtiedPrims && !isNew && moved)
+                {
+                    outputDirtiedPrims->emplace_back(childPath,
+                                                     HdDataSourceLocatorSet{ HdXformSchema::GetDefaultLocator() });
+                }
+                continue;
+            }
+
+            // Tiles of the same shape share their topology arrays.
+            std::pair<int, int> shape(region.width, region.height);
+            _Tile& topology = topologies[shape];
+            if (!topology.faceVertexCountsDs)
+            {
+                if (previous != _tiles.end() && previous->second.region.width == region.width &&
+                    previous->second.region.height == region.height)
+                {
+                    topology = previous->second;
+                }
+                else
+                {
+                    VtIntArray faceVertexCounts, faceVertexIndices;
+                    buildGridTopology(region.width, region.height, &faceVertexCounts, &faceVertexIndices);
+                    _stats->AddBytesAllocated((faceVertexCounts.size() + faceVertexIndices.size()) * sizeof(int));
+                    topology.faceVertexCountsDs  = HdRetainedTypedSampledDataSource<VtIntArray>::New(faceVertexCounts);
+                    topology.faceVertexIndicesDs = HdRetainedTypedSampledDataSource<VtIntArray>::New(faceVertexIndices);
+                }
+            }
+            _Tile& t              = tiles[childPath];
+            t.region              = region;
+            t.offset              = offset;
+            t.faceVertexCountsDs  = topology.faceVertexCountsDs;
+            t.faceVertexIndicesDs = topology.faceVertexIndicesDs;
+            t.pointsDs            = _GridPointsDataSource::New(region, _stats);
 
-    // ̃Tvł̓LbV͖ŖSĂ邪A{͌ʂɍXVǗׂ
-    SdfPath path      = _GetProceduralPrimPath();
-    SdfPath childPath = path.AppendChild(_tokens->pc); // Hydra Rprim BO͉ł
-    result[childPath] = HdPrimTypeTokens->mesh;
+            if (outputDirtiedPrims && !isNew && previous != _tiles.end())
+            {
+                HdDataSourceLocatorSet locators;
+                locators.append(HdPrimvarsSchema::GetPointsLocator());
+                if (moved)
+                {
+                    locators.append(HdXformSchema::GetDefaultLocator());
+                }
+                if (previous->second.faceVertexCountsDs != t.faceVertexCountsDs)
+                {
+                    locators.append(HdMeshTopologySchema::GetDefaultLocator());
+                }
+                outputDirtiedPrims->emplace_back(childPath, locators);
+            }
+        }
+    }
+    _tiles = std::move(tiles);
 
-    if (outputDirtiedPrims)
+    // The counters change with every evaluation, so an opted-in stats prim is always dirty.
+    _statsEnabled = false;
+    if (HdSampledDataSourceHandle statsDs = primvars.GetPrimvar(_tokens->stats).GetPrimvarValue())
     {
-        outputDirtiedPrims->emplace_back(
-            childPath,
-            HdDataSourceLocatorSet{ HdPrimvarsSchema::GetPointsLocator(), HdMeshTopologySchema::GetDefaultLocator() });
+        _statsEnabled = statsDs->GetValue(0.0f).GetWithDefault(false);
+    }
+    if (_statsEnabled)
+    {
+        SdfPath statsPath = path.AppendChild(_tokens->stats);
+        result[statsPath] = TfToken();
+        if (outputDirtiedPrims && previousResult.find(statsPath) != previousResult.end())
+        {
+            outputDirtiedPrims->emplace_back(statsPath, HdDataSourceLocatorSet{ HdDataSourceLocator(_tokens->stats) });
+        }
     }
 
     return result;
@@ -74,52 +285,41 @@ MyProceduralMesh::Update(const HdSceneIndexBaseRefPtr& inputScene,
 HdSceneIndexPrim
 MyProceduralMesh::GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const SdfPath& childPrimPath)
 {
+    TRACE_FUNCTION();
     HdSceneIndexPrim result;
+    // Only the stats child Update returned, while it is enabled.
+    if (_statsEnabled && childPrimPath == _GetProceduralPrimPath().AppendChild(_tokens->stats))
+    {
+        result.dataSource = HdRetainedContainerDataSource::New(_tokens->stats, MyProceduralStats::GetDataSource(_stats));
+        return result;
+    }
 
-    // size ̃Obh󃁃bV𒼂ɖ쐬Tv
-    int size   = int(_size);
-    int stride = size + 1;
-    VtIntArray faceVertexCounts;
-    VtIntArray faceVertexIndices;
-    faceVertexCounts.reserve(size * size);
-    faceVertexIndices.reserve(size * size * 4);
-    VtVec3fArray points(stride * stride);
-    int index = 0;
-    for (int z = 0; z <= size; ++z)
+    auto it = _tiles.find(childPrimPath);
+    if (it == _tiles.end())
     {
-        for (int x = 0; x <= size; ++x)
-        {
-            if (x > 0 && z > 0)
-            {
-                faceVertexCounts.push_back(4);
-                faceVertexIndices.push_back(index - stride);
-                faceVertexIndices.push_back(index - stride - 1);
-                faceVertexIndices.push_back(index - 1);
-                faceVertexIndices.push_back(index);
-            }
-            float y         = sin(x + _param) * cos(z + _param);
-            points[index++] = GfVec3f(x - size / 2 - 0.5f, y, z - size / 2 - 0.5f);
-        }
+        return result;
     }
+    _Tile const& tile = it->second;
 
     result.primType   = HdPrimTypeTokens->mesh;
     result.dataSource = HdRetainedContainerDataSource::New(
         HdXformSchemaTokens->xform,
         HdXformSchema::Builder()
-            .SetMatrix(HdRetainedTypedSampledDataSource<GfMatrix4d>::New(GfMatrix4d().SetIdentity()))
+            .SetMatrix(HdRetainedTypedSampledDataSource<GfMatrix4d>::New(
+                GfMatrix4d().SetTranslate(GfVec3d(-tile.offset, 0.0, -tile.offset))))
             .Build(),
         HdMeshSchemaTokens->mesh,
         HdMeshSchema::Builder()
             .SetTopology(HdMeshTopologySchema::Builder()
-                             .SetFaceVertexCounts(HdRetainedTypedSampledDataSource<VtIntArray>::New(faceVertexCounts))
-                             .SetFaceVertexIndices(HdRetainedTypedSampledDataSource<VtIntArray>::New(faceVertexIndices))
+                             .SetFaceVertexCounts(tile.faceVertexCountsDs)
+                             .SetFaceVertexIndices(tile.faceVertexIndicesDs)
                              .Build())
             .Build(),
         HdPrimvarsSchemaTokens->primvars,
         HdRetainedContainerDataSource::New(
             HdPrimvarsSchemaTokens->points,
             HdPrimvarSchema::Builder()
-                .SetPrimvarValue(HdRetainedTypedSampledDataSource<VtArray<GfVec3f>>::New(points))
+                .SetPrimvarValue(tile.pointsDs)
                 .SetInterpolation(HdPrimvarSchema::BuildInterpolationDataSource(HdPrimvarSchemaTokens->vertex))
                 .SetRole(HdPrimvarSchema::BuildRoleDataSource(HdPrimvarSchemaTokens->point))
                 .Build()));
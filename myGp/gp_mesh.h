@@ -1,10 +1,14 @@
 #pragma once
 
+#include "gp_stats.h"
+
 #include "pxr/imaging/hdGp/generativeProcedural.h"
 
 #include "pxr/imaging/hd/primvarsSchema.h"
 #include "pxr/imaging/hd/retainedDataSource.h"
 
+#include <map>
+
 PXR_NAMESPACE_OPEN_SCOPE
 
 class MyProceduralMesh : public HdGpGenerativeProcedural
@@ -22,9 +26,33 @@ public:
 
     HdSceneIndexPrim GetChildPrim(const HdSceneIndexBaseRefPtr& inputScene, const SdfPath& childPrimPath) override;
 
+    // Quads [x0, x0 + width) x [z0, z0 + height) of the grid and what their vertices depend on.
+    // Vertices are in grid coordinates; centring the grid is left to the tile's xform.
+    struct GridRegion
+    {
+        int x0 = 0, z0 = 0, width = 0, height = 0;
+        float param = 0.0f;
+
+        bool operator==(GridRegion const& other) const
+        {
+            return x0 == other.x0 && z0 == other.z0 && width == other.width && height == other.height &&
+                   param == other.param;
+        }
+    };
+
 private:
+    struct _Tile
+    {
+        GridRegion region;
+        float offset = 0.0f; // moves the grid centre to the origin
+        HdSampledDataSourceHandle faceVertexCountsDs, faceVertexIndicesDs, pointsDs;
+    };
+
     float _size  = 1.0f;
     float _param = 0.0f;
+    std::map<SdfPath, _Tile> _tiles;
+    MyProceduralStatsSharedPtr _stats;
+    bool _statsEnabled = false; // primvars:stats as of the last Update
 };
 
 PXR_NAMESPACE_CLOSE_SCOPE
\ No newline at end of file
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <pxr/pxr.h>
+
+#include <cstdint>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Counter-based generator: each value is a pure function of (stream, counter), so samples
+// can be drawn for any face or curve on any thread and still come out identical to a serial run.
+class MyRandomStream
+{
+public:
+    explicit MyRandomStream(uint32_t stream)
+        : _key(uint64_t(stream) << 32)
+    {
+    }
+    float Next() { return float(_Mix(_key | _counter++) >> 40) * (1.0f / 16777216.0f); }
+
+private:
+    static uint64_t _Mix(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+    uint64_t _key;
+    uint32_t _counter = 0;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
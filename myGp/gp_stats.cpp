@@ -0,0 +1,149 @@
+#include "gp_stats.h"
+
+#include "pxr/imaging/hd/perfLog.h"
+#include "pxr/imaging/hd/retainedDataSource.h"
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_PRIVATE_TOKENS(_tokens,
+                         (curvesEmitted)   //
+                         (pointsEmitted)   //
+                         (refinerRebuilds) //
+                         (bytesAllocated)  //
+                         (bytesBaked)      //
+                         (evaluationTime)  //
+);
+
+namespace {
+TfToken
+counterToken(std::string const& name, TfToken const& counter)
+{
+    return TfToken(name + "_" + counter.GetString());
+}
+
+class _StatsDataSource : public HdContainerDataSource
+{
+public:
+    HD_DECLARE_DATASOURCE(_StatsDataSource);
+
+    TfTokenVector GetNames() override
+    {
+        return { _tokens->curvesEmitted,
+                 _tokens->pointsEmitted,
+                 _tokens->refinerRebuilds,
+                 _tokens->bytesAllocated,
+                 _tokens->bytesBaked,
+                 _tokens->evaluationTime };
+    }
+    HdDataSourceBaseHandle Get(TfToken const& name) override
+    {
+        MyProceduralStats::Counters counters = _stats->GetCounters();
+        if (name == _tokens->curvesEmitted)
+        {
+            return HdRetainedTypedSampledDataSource<uint64_t>::New(counters.curvesEmitted);
+        }
+        if (name == _tokens->pointsEmitted)
+        {
+            return HdRetainedTypedSampledDataSource<uint64_t>::New(counters.pointsEmitted);
+        }
+        if (name == _tokens->refinerRebuilds)
+        {
+            return HdRetainedTypedSampledDataSource<uint64_t>::New(counters.refinerRebuilds);
+        }
+        if (name == _tokens->bytesAllocated)
+        {
+            return HdRetainedTypedSampledDataSource<uint64_t>::New(counters.bytesAllocated);
+        }
+        if (name == _tokens->bytesBaked)
+        {
+            return HdRetainedTypedSampledDataSource<uint64_t>::New(counters.bytesBaked);
+        }
+        if (name == _tokens->evaluationTime)
+        {
+            return HdRetainedTypedSampledDataSource<double>::New(counters.evaluationTime);
+        }
+        return nullptr;
+    }
+
+private:
+    _StatsDataSource(std::shared_ptr<MyProceduralStats const> const& stats)
+        : _stats(stats)
+    {
+    }
+
+    std::shared_ptr<MyProceduralStats const> _stats;
+};
+} // namespace
+
+MyProceduralStats::MyProceduralStats(std::string const& name)
+    : _curvesEmittedToken(counterToken(name, _tokens->curvesEmitted))
+    , _pointsEmittedToken(counterToken(name, _tokens->pointsEmitted))
+    , _refinerRebuildsToken(counterToken(name, _tokens->refinerRebuilds))
+    , _bytesAllocatedToken(counterToken(name, _tokens->bytesAllocated))
+    , _bytesBakedToken(counterToken(name, _tokens->bytesBaked))
+    , _evaluationTimeToken(counterToken(name, _tokens->evaluationTime))
+{
+}
+
+void
+MyProceduralStats::AddCurvesEmitted(size_t count)
+{
+    _curvesEmitted += count;
+    HD_PERF_COUNTER_ADD(_curvesEmittedToken, double(count));
+}
+
+void
+MyProceduralStats::AddPointsEmitted(size_t count)
+{
+    _pointsEmitted += count;
+    HD_PERF_COUNTER_ADD(_pointsEmittedToken, double(count));
+}
+
+void
+MyProceduralStats::AddRefinerRebuild()
+{
+    ++_refinerRebuilds;
+    HD_PERF_COUNTER_INCR(_refinerRebuildsToken);
+}
+
+void
+MyProceduralStats::AddBytesAllocated(size_t bytes)
+{
+    _bytesAllocated += bytes;
+    HD_PERF_COUNTER_ADD(_bytesAllocatedToken, double(bytes));
+}
+
+void
+MyProceduralStats::AddBytesBaked(size_t bytes)
+{
+    _bytesBaked += bytes;
+    HD_PERF_COUNTER_ADD(_bytesBakedToken, double(bytes));
+}
+
+void
+MyProceduralStats::AddEvaluationTime(double seconds)
+{
+    _evaluationTimeNs += uint64_t(seconds * 1e9);
+    HD_PERF_COUNTER_ADD(_evaluationTimeToken, seconds);
+}
+
+MyProceduralStats::Counters
+MyProceduralStats::GetCounters() const
+{
+    Counters counters;
+    counters.curvesEmitted   = _curvesEmitted;
+    counters.pointsEmitted   = _pointsEmitted;
+    counters.refinerRebuilds = _refinerRebuilds;
+    counters.bytesAllocated  = _bytesAllocated;
+    counters.bytesBaked      = _bytesBaked;
+    counters.evaluationTime  = double(_evaluationTimeNs) * 1e-9;
+    return counters;
+}
+
+HdContainerDataSourceHandle
+MyProceduralStats::GetDataSource(std::shared_ptr<MyProceduralStats const> const& stats)
+{
+    return _StatsDataSource::New(stats);
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <pxr/base/tf/token.h>
+#include <pxr/imaging/hd/dataSource.h>
+#include <pxr/pxr.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Running totals of the work done by one procedural. Every addition is also forwarded to the
+// process-wide HdPerfLog counters of the procedural type (<name>_curvesEmitted, ...), which
+// only record while perf logging is enabled.
+class MyProceduralStats
+{
+public:
+    struct Counters
+    {
+        uint64_t curvesEmitted   = 0;
+        uint64_t pointsEmitted   = 0;
+        uint64_t refinerRebuilds = 0;
+        uint64_t bytesAllocated  = 0;
+        uint64_t bytesBaked      = 0;   // written to the bake cache
+        double evaluationTime    = 0.0; // seconds
+    };
+
+    explicit MyProceduralStats(std::string const& name);
+
+    void AddCurvesEmitted(size_t count);
+    void AddPointsEmitted(size_t count);
+    void AddRefinerRebuild();
+    void AddBytesAllocated(size_t bytes);
+    void AddBytesBaked(size_t bytes);
+    void AddEvaluationTime(double seconds);
+
+    Counters GetCounters() const;
+
+    // Read-only container with one sampled value per counter, read when pulled.
+    static HdContainerDataSourceHandle GetDataSource(std::shared_ptr<MyProceduralStats const> const& stats);
+
+private:
+    TfToken _curvesEmittedToken, _pointsEmittedToken, _refinerRebuildsToken, _bytesAllocatedToken, _bytesBakedToken,
+        _evaluationTimeToken;
+    std::atomic<uint64_t> _curvesEmitted{ 0 };
+    std::atomic<uint64_t> _pointsEmitted{ 0 };
+    std::atomic<uint64_t> _refinerRebuilds{ 0 };
+    std::atomic<uint64_t> _bytesAllocated{ 0 };
+    std::atomic<uint64_t> _bytesBaked{ 0 };
+    std::atomic<uint64_t> _evaluationTimeNs{ 0 };
+};
+using MyProceduralStatsSharedPtr = std::shared_ptr<MyProceduralStats>;
+
+// Adds the lifetime of the scope to the evaluation time of stats, if any.
+class MyScopedEvaluationTimer
+{
+public:
+    explicit MyScopedEvaluationTimer(MyProceduralStats* stats)
+        : _stats(stats)
+        , _start(std::chrono::steady_clock::now())
+    {
+    }
+    ~MyScopedEvaluationTimer()
+    {
+        if (_stats)
+        {
+            _stats->AddEvaluationTime(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - _start).count());
+        }
+    }
+
+private:
+    MyProceduralStats* _stats;
+    std::chrono::steady_clock::time_point _start;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE
@@ -0,0 +1,250 @@
+#include "gp_topologyCache.h"
+#include "gp_debugCodes.h"
+
+#include "pxr/base/arch/hash.h"
+#include "pxr/base/tf/envSetting.h"
+#include "pxr/base/trace/trace.h"
+
+#include <opensubdiv/far/patchTableFactory.h>
+#include <opensubdiv/far/topologyDescriptor.h>
+
+#include <algorithm>
+#include <future>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+TF_DEFINE_ENV_SETTING(MYGP_TOPOLOGY_CACHE_BUDGET_MB, 1024, "Memory budget of the shared refiner/patch table cache");
+
+namespace {
+uint64_t
+computeHash(VtIntArray const& counts, VtIntArray const& indices, int numVertices, MyTopologyOptions const& options)
+{
+    uint64_t h = ArchHash64(reinterpret_cast<char const*>(counts.cdata()), counts.size() * sizeof(int));
+    h          = ArchHash64(reinterpret_cast<char const*>(indices.cdata()), indices.size() * sizeof(int), h);
+    int const header[] = { numVertices,           int(counts.size()),         int(indices.size()),
+                           int(options.scheme),   int(options.boundary),      int(options.refine),
+                           options.isolationLevel, int(options.endCap) };
+    return ArchHash64(reinterpret_cast<char const*>(header), sizeof(header), h);
+}
+
+// Rough footprint of the refiner tables and the patch table, good enough for budgeting.
+size_t
+estimateMemoryUsage(OpenSubdiv::Far::TopologyRefiner const& refiner, OpenSubdiv::Far::PatchTable const& patchTable)
+{
+    using namespace OpenSubdiv;
+    size_t bytes = 0;
+    for (int level = 0; level < refiner.GetNumLevels(); ++level)
+    {
+        Far::TopologyLevel const& l = refiner.GetLevel(level);
+        bytes += sizeof(Far::Index) * (4 * size_t(l.GetNumFaceVertices()) + 4 * size_t(l.GetNumEdges()) +
+                                       2 * size_t(l.GetNumVertices()));
+    }
+    bytes += sizeof(Far::Index) * size_t(patchTable.GetNumControlVerticesTotal());
+    bytes += sizeof(Far::PatchParam) * size_t(patchTable.GetNumPatchesTotal());
+    if (Far::StencilTable const* localPoints = patchTable.GetLocalPointStencilTable())
+    {
+        bytes += (sizeof(Far::Index) + sizeof(float)) * localPoints->GetControlIndices().size();
+        bytes += 2 * sizeof(int) * size_t(localPoints->GetNumStencils());
+    }
+    return bytes;
+}
+
+std::shared_ptr<MyTopology>
+buildTopology(VtIntArray const& counts, VtIntArray const& indices, int numVertices, MyTopologyOptions const& options)
+{
+    TRACE_FUNCTION();
+    using namespace OpenSubdiv;
+
+    using Descriptor     = Far::TopologyDescriptor;
+    Sdc::SchemeType type = options.scheme;
+    Sdc::Options sdcOptions;
+    sdcOptions.SetVtxBoundaryInterpolation(options.boundary);
+    Descriptor desc;
+    desc.numVertices        = numVertices;
+    desc.numFaces           = (int)counts.size();
+    desc.numVertsPerFace    = counts.cdata();
+    desc.vertIndicesPerFace = indices.cdata();
+
+    auto topology               = std::make_shared<MyTopology>();
+    topology->faceVertexCounts  = counts;
+    topology->faceVertexIndices = indices;
+    topology->numVertices       = numVertices;
+    topology->options           = options;
+    if (!options.refine)
+    {
+        topology->memoryUsage = sizeof(MyTopology);
+        return topology;
+    }
+
+    topology->refiner.reset(Far::TopologyRefinerFactory<Descriptor>::Create(
+        desc, Far::TopologyRefinerFactory<Descriptor>::Options(type, sdcOptions)));
+    if (!topology->refiner)
+    {
+        return nullptr;
+    }
+
+    Far::PatchTableFactory::Options patchOptions;
+    patchOptions.SetPatchPrecision<float>();
+    patchOptions.useInfSharpPatch      = true;
+    patchOptions.generateVaryingTables = false;
+    patchOptions.endCapType            = options.endCap;
+    patchOptions.maxIsolationLevel     = unsigned(std::clamp(options.isolationLevel, 0, 10));
+
+    // The adaptive refinement has to match the patch options, isolation level included.
+    Far::TopologyRefiner::AdaptiveOptions adaptiveOptions = patchOptions.GetRefineAdaptiveOptions();
+    {
+        TRACE_SCOPE("RefineAdaptive");
+        topology->refiner->RefineAdaptive(adaptiveOptions);
+    }
+    {
+        TRACE_SCOPE("PatchTableFactory::Create");
+        topology->patchTable.reset(Far::PatchTableFactory::Create(*topology->refiner, patchOptions));
+    }
+
+    topology->memoryUsage = estimateMemoryUsage(*topology->refiner, *topology->patchTable);
+    TF_DEBUG(MYGP_REFINER)
+        .Msg("Refined %zu faces / %d vertices into %d patches (%zu bytes)\n",
+             counts.size(),
+             numVertices,
+             topology->patchTable->GetNumPatchesTotal(),
+             topology->memoryUsage);
+    return topology;
+}
+} // namespace
+
+MyTopologyCache&
+MyTopologyCache::GetInstance()
+{
+    static MyTopologyCache instance;
+    return instance;
+}
+
+MyTopologyCache::MyTopologyCache()
+{
+    _stats.budget = size_t(TfGetEnvSetting(MYGP_TOPOLOGY_CACHE_BUDGET_MB)) << 20;
+}
+
+MyTopologySharedPtr
+MyTopologyCache::Get(VtIntArray const& faceVertexCounts,
+                     VtIntArray const& faceVertexIndices,
+                     int numVertices,
+                     MyTopologyOptions const& options,
+                     bool* built)
+{
+    TRACE_FUNCTION();
+    if (built)
+    {
+        *built = false;
+    }
+    auto matches = [&](MyTopologySharedPtr const& t) {
+        return t && t->numVertices == numVertices && t->options == options &&
+               t->faceVertexCounts == faceVertexCounts && t->faceVertexIndices == faceVertexIndices;
+    };
+    uint64_t hash = computeHash(faceVertexCounts, faceVertexIndices, numVertices, options);
+    std::promise<MyTopologySharedPtr> promise;
+    bool owner = false;
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto it = _entries.find(hash);
+        if (it != _entries.end() && matches(*it->second))
+        {
+            _lru.splice(_lru.begin(), _lru, it->second);
+            ++_stats.hits;
+            return _lru.front();
+        }
+        ++_stats.misses;
+        // Concurrent misses on the same topology wait for the one build already under way.
+        auto building = _building.find(hash);
+        if (building != _building.end())
+        {
+            std::shared_future<MyTopologySharedPtr> future = building->second;
+            lock.unlock();
+            TRACE_SCOPE("Wait for topology build");
+            MyTopologySharedPtr topology = future.get();
+            if (matches(topology))
+            {
+                return topology;
+            }
+            // A hash collision or a failed build; fall through to building it here.
+        }
+        else
+        {
+            _building.emplace(hash, promise.get_future().share());
+            owner = true;
+        }
+        TF_DEBUG(MYGP_TOPOLOGY_CACHE)
+            .Msg("Topology cache miss for %zu faces / %d vertices (hash %016llx)\n",
+                 faceVertexCounts.size(),
+                 numVertices,
+                 (unsigned long long)hash);
+    }
+
+    // Refine outside the lock, so other topologies can be looked up and built meanwhile.
+    std::shared_ptr<MyTopology> topology = buildTopology(faceVertexCounts, faceVertexIndices, numVertices, options);
+    if (topology)
+    {
+        topology->hash = hash;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (owner)
+    {
+        _building.erase(hash);
+        promise.set_value(topology);
+    }
+    if (!topology)
+    {
+        return nullptr;
+    }
+    if (built)
+    {
+        *built = true;
+    }
+
+    auto it = _entries.find(hash);
+    if (it != _entries.end())
+    {
+        _stats.bytes -= (*it->second)->memoryUsage;
+        _lru.erase(it->second);
+        _entries.erase(it);
+    }
+    _lru.push_front(topology);
+    _entries[hash] = _lru.begin();
+    _stats.bytes += topology->memoryUsage;
+    _stats.entries = _entries.size();
+    _EvictLocked();
+    return topology;
+}
+
+void
+MyTopologyCache::SetMemoryBudget(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.budget = bytes;
+    _EvictLocked();
+}
+
+MyTopologyCache::Stats
+MyTopologyCache::GetStats() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+
+void
+MyTopologyCache::_EvictLocked()
+{
+    // Always keep the most recent entry, even if it alone exceeds the budget.
+    while (_stats.bytes > _stats.budget && _lru.size() > 1)
+    {
+        MyTopologySharedPtr const& victim = _lru.back();
+        TF_DEBUG(MYGP_TOPOLOGY_CACHE)
+            .Msg("Topology cache evicts %016llx (%zu bytes)\n", (unsigned long long)victim->hash, victim->memoryUsage);
+        _stats.bytes -= victim->memoryUsage;
+        _entries.erase(victim->hash);
+        _lru.pop_back();
+        ++_stats.evictions;
+    }
+    _stats.entries = _entries.size();
+}
+
+PXR_NAMESPACE_CLOSE_SCOPE
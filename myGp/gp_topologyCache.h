@@ -0,0 +1,109 @@
+#pragma once
+
+#include <pxr/base/vt/array.h>
+#include <pxr/pxr.h>
+
+#include <opensubdiv/far/patchTable.h>
+#include <opensubdiv/far/patchTableFactory.h>
+#include <opensubdiv/far/topologyRefiner.h>
+
+#include <cstdint>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+PXR_NAMESPACE_OPEN_SCOPE
+
+// Scheme and patch options that take part in the topology fingerprint.
+struct MyTopologyOptions
+{
+    using EndCapType = OpenSubdiv::Far::PatchTableFactory::Options::EndCapType;
+
+    OpenSubdiv::Sdc::SchemeType scheme                          = OpenSubdiv::Sdc::SCHEME_CATMARK;
+    OpenSubdiv::Sdc::Options::VtxBoundaryInterpolation boundary = OpenSubdiv::Sdc::Options::VTX_BOUNDARY_EDGE_ONLY;
+    // Without refinement the topology only carries the mesh arrays (no refiner, no patch
+    // table), for callers that work on the control cage.
+    bool refine        = true;
+    int isolationLevel = 10; // adaptive isolation depth, at most 10
+    EndCapType endCap  = OpenSubdiv::Far::PatchTableFactory::Options::ENDCAP_GREGORY_BASIS;
+
+    bool operator==(MyTopologyOptions const& other) const
+    {
+        return scheme == other.scheme && boundary == other.boundary && refine == other.refine &&
+               isolationLevel == other.isolationLevel && endCap == other.endCap;
+    }
+    bool operator!=(MyTopologyOptions const& other) const { return !(*this == other); }
+};
+
+// Adaptively refined topology and its patch table (both null unless options.refine).
+// Immutable once published by the cache, so it can be shared by every procedural that
+// sources the same mesh topology.
+struct MyTopology
+{
+    bool IsIdentical(VtIntArray const& counts,
+                     VtIntArray const& indices,
+                     int nVertices,
+                     MyTopologyOptions const& opts) const
+    {
+        return faceVertexCounts.IsIdentical(counts) && faceVertexIndices.IsIdentical(indices) &&
+               numVertices == nVertices && options == opts;
+    }
+
+    VtIntArray faceVertexCounts, faceVertexIndices;
+    int numVertices = 0;
+    MyTopologyOptions options;
+    uint64_t hash      = 0;
+    size_t memoryUsage = 0;
+
+    std::unique_ptr<OpenSubdiv::Far::TopologyRefiner> refiner;
+    std::unique_ptr<OpenSubdiv::Far::PatchTable const> patchTable;
+};
+using MyTopologySharedPtr = std::shared_ptr<MyTopology const>;
+
+// Process-wide LRU cache of refined topologies keyed by a fingerprint of the face counts,
+// face indices, vertex count and options. Entries are evicted once the estimated memory
+// exceeds the budget (MYGP_TOPOLOGY_CACHE_BUDGET_MB); evicted entries stay alive for as
+// long as a procedural still holds them.
+class MyTopologyCache
+{
+public:
+    struct Stats
+    {
+        size_t hits      = 0;
+        size_t misses    = 0;
+        size_t evictions = 0;
+        size_t entries   = 0;
+        size_t bytes     = 0;
+        size_t budget    = 0;
+    };
+
+    static MyTopologyCache& GetInstance();
+
+    // Returns the shared topology for the given mesh, building it on a miss (reported
+    // through built when given). Concurrent misses on the same topology share one build.
+    // Returns null when OpenSubdiv rejects the topology.
+    MyTopologySharedPtr Get(VtIntArray const& faceVertexCounts,
+                            VtIntArray const& faceVertexIndices,
+                            int numVertices,
+                            MyTopologyOptions const& options,
+                            bool* built = nullptr);
+
+    void SetMemoryBudget(size_t bytes);
+    Stats GetStats() const;
+
+private:
+    MyTopologyCache();
+    void _EvictLocked();
+
+    using _EntryList = std::list<MyTopologySharedPtr>;
+
+    mutable std::mutex _mutex;
+    _EntryList _lru; // most recently used first
+    std::unordered_map<uint64_t, _EntryList::iterator> _entries;
+    std::unordered_map<uint64_t, std::shared_future<MyTopologySharedPtr>> _building; // in flight
+    Stats _stats;
+};
+
+PXR_NAMESPACE_CLOSE_SCOPE